@@ -0,0 +1,277 @@
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "ElementaryIntervals.h"
+
+/// Computes the inverses modulo \p base of 1 .. base - 1 (a^(base - 2), Fermat's little theorem)
+/// @returns false if \p base is not prime (some value has no inverse)
+static bool inverses(uint64_t base, std::vector<uint64_t>& inv) {
+    if (base < 2) return false;
+    inv.assign(base, 0);
+    for (uint64_t a = 1; a < base; ++a){
+        uint64_t result = 1, power = a;
+        for (uint64_t e = base - 2; e; e >>= 1){
+            if (e & 1) result = result * power % base;
+            power = power * power % base;
+        }
+        if (a * result % base != 1) return false;
+        inv[a] = result;
+    }
+    return true;
+}
+
+/// Writes the \p count most significant first digits of \p v in \p digits
+static void toDigits(uint64_t v, int count, uint64_t base, uint64_t* digits) {
+    for (int i = count; i-- > 0;){
+        digits[i] = v % base;
+        v /= base;
+    }
+}
+
+/// Returns the addresses of \p samplers
+static std::vector<const MatrixSampler*> addresses(const std::vector<MatrixSampler>& samplers) {
+    std::vector<const MatrixSampler*> pointers;
+    for (const MatrixSampler& sampler : samplers) pointers.push_back(&sampler);
+    return pointers;
+}
+
+IntervalIndexCache::IntervalIndexCache(const std::vector<MatrixSampler>& samplers) :
+    IntervalIndexCache(addresses(samplers)) {}
+
+IntervalIndexCache::IntervalIndexCache(const std::vector<const MatrixSampler*>& samplers) : m_samplers(samplers) {
+    if (m_samplers.empty()) return;
+    m_size = m_samplers[0]->m_size;
+    m_base = m_samplers[0]->m_base;
+    if (!inverses(m_base, m_inv)) m_inv.clear();
+    if (m_base != 2 && PackedDigits::fits(m_base, m_size))
+        m_packing = PackedDigits(m_base, m_size);
+}
+
+int IntervalIndexCache::getEntry(int dimX, int dimY, int k, int l) {
+    for (size_t e = 0; e < m_entries.size(); ++e){
+        const Entry& entry = m_entries[e];
+        if (entry.dimX == dimX && entry.dimY == dimY && entry.k == k && entry.l == l) return int(e);
+    }
+    const int nDims = int(m_samplers.size());
+    if (dimX < 0 || dimY < 0 || dimX >= nDims || dimY >= nDims){
+        std::cerr << "Error: elementary interval dimensions (" << dimX << ", " << dimY << ") out of [0, " << nDims << ")" << std::endl;
+        return -1;
+    }
+    const MatrixSampler& samplerX = *m_samplers[dimX];
+    const MatrixSampler& samplerY = *m_samplers[dimY];
+    const uint64_t m = m_size;
+    const uint64_t base = m_base;
+    if (samplerX.m_size != m || samplerX.m_base != base || samplerY.m_size != m || samplerY.m_base != base){
+        std::cerr << "Error: elementary intervals need matrices of the same size and base" << std::endl;
+        return -1;
+    }
+    //Indices are 64 bits: the query buffers hold at most 64 digits per interval and free index digits
+    if (m > 64){
+        std::cerr << "Error: elementary intervals need matrices of size at most 64, got " << m << std::endl;
+        return -1;
+    }
+    if (k < 0 || l < 0 || uint64_t(k) > m || uint64_t(l) > m){
+        std::cerr << "Error: elementary interval resolution (" << k << ", " << l << ") out of [0, " << m << "]" << std::endl;
+        return -1;
+    }
+    if (m_inv.empty()){
+        std::cerr << "Error: elementary intervals need a prime base, got " << base << std::endl;
+        return -1;
+    }
+
+    //Reduced row echelon form of [A | I]: the k first rows of the first matrix, then the l first rows of the
+    //second one. The right block T gives the reduced interval digits T t of any interval t.
+    const uint64_t rows = k + l;
+    const uint64_t width = m + rows;
+    std::vector<uint64_t> sys(rows * width, 0);
+    for (uint64_t r = 0; r < rows; ++r){
+        const std::vector<int>& mat = r < uint64_t(k) ? samplerX.m_m : samplerY.m_m;
+        const uint64_t row = r < uint64_t(k) ? r : r - k;
+        for (uint64_t col = 0; col < m; ++col){
+            sys[r * width + col] = uint64_t(mat[row * m + col]) % base;
+        }
+        sys[r * width + m + r] = 1;
+    }
+    std::vector<uint64_t> pivots;
+    std::vector<bool> isPivot(m, false);
+    uint64_t rank = 0;
+    for (uint64_t col = 0; col < m && rank < rows; ++col){
+        uint64_t p = rank;
+        while (p < rows && sys[p * width + col] == 0) ++p;
+        if (p == rows) continue;
+        std::swap_ranges(&sys[p * width], &sys[p * width] + width, &sys[rank * width]);
+        uint64_t* pivotRow = &sys[rank * width];
+        const uint64_t scale = m_inv[pivotRow[col]];
+        for (uint64_t c = 0; c < width; ++c) pivotRow[c] = pivotRow[c] * scale % base;
+        for (uint64_t r = 0; r < rows; ++r){
+            const uint64_t factor = sys[r * width + col];
+            if (r == rank || factor == 0) continue;
+            for (uint64_t c = 0; c < width; ++c){
+                sys[r * width + c] = (sys[r * width + c] + (base - factor) * pivotRow[c]) % base;
+            }
+        }
+        pivots.push_back(col);
+        isPivot[col] = true;
+        ++rank;
+    }
+    std::vector<uint64_t> freeCols;
+    for (uint64_t col = 0; col < m; ++col){
+        if (!isPivot[col]) freeCols.push_back(col);
+    }
+
+    //Map from (interval digits, free digits) to index digits: pivot digit r is (T t)_r minus the free digits
+    //weighted by row r, free digits are copied. Free digits are taken least significant first, so that
+    //solution numbers and indices have the same order (pivot digits only depend on higher free digits).
+    const uint64_t inputs = rows + freeCols.size();
+    std::vector<uint64_t> map(inputs * m, 0);
+    for (uint64_t r = 0; r < rank; ++r){
+        for (uint64_t i = 0; i < rows; ++i){
+            map[i * m + pivots[r]] = sys[r * width + m + i];
+        }
+        for (size_t f = 0; f < freeCols.size(); ++f){
+            map[(rows + f) * m + pivots[r]] = (base - sys[r * width + freeCols[f]]) % base;
+        }
+    }
+    for (size_t f = 0; f < freeCols.size(); ++f){
+        map[(rows + f) * m + freeCols[f]] = 1;
+    }
+
+    Entry entry;
+    entry.dimX = dimX;
+    entry.dimY = dimY;
+    entry.k = k;
+    entry.l = l;
+    entry.rows = rows;
+    entry.free = freeCols.size();
+    entry.offset = m_arena.size();
+    for (uint64_t c = 0; c < inputs; ++c){
+        const uint64_t* digits = &map[c * m];
+        if (m_base == 2){
+            uint64_t bits = 0;
+            for (uint64_t i = 0; i < m; ++i) bits |= digits[i] << i;
+            m_arena.push_back(bits);
+        } else if (m_packing.m_size != 0){
+            for (uint64_t d = 0; d < base; ++d){
+                uint64_t value = 0;
+                for (uint64_t i = m; i-- > 0;) value = value * base + d * digits[i] % base;
+                m_arena.push_back(m_packing.pack(value));
+            }
+        } else {
+            m_arena.insert(m_arena.end(), digits, digits + m);
+        }
+    }
+    //Rows without pivot read 0 = (T t)_r
+    entry.check = m_arena.size();
+    entry.checks = rows - rank;
+    for (uint64_t r = rank; r < rows; ++r){
+        m_arena.insert(m_arena.end(), &sys[r * width + m], &sys[r * width + m] + rows);
+    }
+    m_entries.push_back(entry);
+    return int(m_entries.size() - 1);
+}
+
+uint64_t IntervalIndexCache::getCount(int entry, uint64_t x, uint64_t y) const {
+    const Entry& e = m_entries[entry];
+    if (e.checks != 0){
+        std::array<uint64_t, 128> digits;
+        intervalDigits(e, x, y, digits.data());
+        for (uint64_t r = 0; r < e.checks; ++r){
+            const uint64_t* row = &m_arena[e.check + r * e.rows];
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < e.rows; ++i) sum = (sum + row[i] * digits[i]) % m_base;
+            if (sum != 0) return 0;
+        }
+    }
+    uint64_t count = 1;
+    for (uint64_t f = 0; f < e.free; ++f) count *= m_base;
+    return count;
+}
+
+uint64_t IntervalIndexCache::getIndex(int entry, uint64_t x, uint64_t y, uint64_t j) const {
+    const Entry& e = m_entries[entry];
+    if (m_base == 2){
+        //Digits are bits: xor of the columns of the set bits
+        const uint64_t* cols = &m_arena[e.offset];
+        uint64_t n = 0;
+        for (int i = 0; i < e.k; ++i) n ^= cols[i] & (uint64_t(0) - ((x >> (e.k - 1 - i)) & 1));
+        for (int i = 0; i < e.l; ++i) n ^= cols[e.k + i] & (uint64_t(0) - ((y >> (e.l - 1 - i)) & 1));
+        for (uint64_t f = 0; f < e.free; ++f) n ^= cols[e.rows + f] & (uint64_t(0) - ((j >> f) & 1));
+        return n;
+    }
+    std::array<uint64_t, 192> digits;
+    intervalDigits(e, x, y, digits.data());
+    for (uint64_t f = 0; f < e.free; ++f){
+        digits[e.rows + f] = j % m_base;
+        j /= m_base;
+    }
+    return apply(e, digits.data());
+}
+
+size_t IntervalIndexCache::getMemory() const {
+    return m_arena.size() * sizeof(uint64_t);
+}
+
+uint64_t IntervalIndexCache::apply(const Entry& e, const uint64_t* digits) const {
+    const uint64_t inputs = e.rows + e.free;
+    const uint64_t* cols = &m_arena[e.offset];
+    if (m_packing.m_size != 0){
+        uint64_t n = 0;
+        for (uint64_t c = 0; c < inputs; ++c){
+            n = m_packing.add(n, cols[c * m_base + digits[c]]);
+        }
+        return m_packing.unpack(n);
+    }
+    std::array<uint64_t, 64> acc = {};
+    for (uint64_t c = 0; c < inputs; ++c){
+        if (digits[c] == 0) continue;
+        for (uint64_t i = 0; i < m_size; ++i){
+            acc[i] = (acc[i] + digits[c] * cols[c * m_size + i]) % m_base;
+        }
+    }
+    uint64_t n = 0;
+    for (uint64_t i = m_size; i-- > 0;) n = n * m_base + acc[i];
+    return n;
+}
+
+void IntervalIndexCache::intervalDigits(const Entry& e, uint64_t x, uint64_t y, uint64_t* digits) const {
+    toDigits(x, e.k, m_base, digits);
+    toDigits(y, e.l, m_base, digits + e.k);
+}
+
+bool getIntervalIndices(const MatrixSampler& dimX, const MatrixSampler& dimY, int k, int l, uint64_t x, uint64_t y,
+                        std::vector<uint64_t>& indices) {
+    indices.clear();
+    IntervalIndexCache cache(std::vector<const MatrixSampler*>{&dimX, &dimY});
+    const int entry = cache.getEntry(0, 1, k, l);
+    if (entry < 0)
+        return false;
+    uint64_t sizeX = 1, sizeY = 1;
+    for (int i = 0; i < k; ++i) sizeX *= dimX.m_base;
+    for (int i = 0; i < l; ++i) sizeY *= dimX.m_base;
+    if (x >= sizeX || y >= sizeY){
+        std::cerr << "Error: elementary interval (" << x << ", " << y << ") out of " << sizeX << " x " << sizeY << std::endl;
+        return false;
+    }
+    const uint64_t count = cache.getCount(entry, x, y);
+    indices.reserve(count);
+    for (uint64_t j = 0; j < count; ++j){
+        indices.push_back(cache.getIndex(entry, x, y, j));
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstdint>
+#include <vector>
+
+#include "MatrixSamplerClass.h"
+#include "PackedDigits.h"
+
+/// Cache of the index maps of elementary intervals: for a pair of dimensions and a resolution (k, l), the
+/// Gaussian elimination of the (k + l) x m system of getIntervalIndices is done once and stored as a linear map
+/// over GF(b) from the interval digits and a solution number j to the index digits. A query is then a small
+/// matrix-vector product. Solutions are numbered by increasing index: getIndex(entry, x, y, 0) is the first
+/// point of the interval in the sequence.
+/// Entries are stored in a single arena; getEntry is not thread safe, getCount and getIndex are.
+class IntervalIndexCache {
+
+public:
+
+  /// Cache over samplers of the same size and prime base
+  /// @param samplers the samplers of all dimensions (must outlive the cache)
+  IntervalIndexCache(const std::vector<MatrixSampler>& samplers);
+
+  /// Cache over samplers of the same size and prime base
+  /// @param samplers the samplers of all dimensions (must outlive the cache)
+  IntervalIndexCache(const std::vector<const MatrixSampler*>& samplers);
+
+  /// Returns the entry of a pair of dimensions at a resolution, computed on first use
+  /// @param dimX the first dimension
+  /// @param dimY the second dimension
+  /// @param k the resolution of the first dimension (b^k intervals, k <= m)
+  /// @param l the resolution of the second dimension (b^l intervals, l <= m)
+  /// @returns the entry, or -1 if the arguments are invalid or the base is not prime
+  int getEntry(int dimX, int dimY, int k, int l);
+
+  /// Returns the number of points in the interval (\p x, \p y) of an entry
+  /// @param entry an entry returned by getEntry
+  /// @param x the interval in the first dimension (< b^k)
+  /// @param y the interval in the second dimension (< b^l)
+  uint64_t getCount(int entry, uint64_t x, uint64_t y) const;
+
+  /// Returns the index of the \p j-th point in the interval (\p x, \p y) of an entry
+  /// (meaningless if \p j >= getCount(entry, x, y))
+  /// @param entry an entry returned by getEntry
+  /// @param x the interval in the first dimension (< b^k)
+  /// @param y the interval in the second dimension (< b^l)
+  /// @param j the solution number
+  uint64_t getIndex(int entry, uint64_t x, uint64_t y, uint64_t j) const;
+
+  /// Returns the size of the arena in bytes
+  size_t getMemory() const;
+
+private:
+
+  struct Entry {
+    int dimX, dimY, k, l;
+    //number of interval digits (k + l) and of free index digits (solution number digits)
+    uint64_t rows, free;
+    //column c of the map (interval digits, then solution number digits) starts at m_arena[offset + c * stride],
+    //stride being 1, b or m (see m_arena)
+    uint64_t offset;
+    //rows - rank constraints on the interval digits, m_arena[check + r * rows + i]: the interval is empty unless
+    //they are all satisfied
+    uint64_t check, checks;
+  };
+
+  /// Returns the index of the map \p e applied to \p digits (interval digits, then solution digits), bases > 2
+  uint64_t apply(const Entry& e, const uint64_t* digits) const;
+
+  /// Writes the k + l digits of interval (\p x, \p y) in \p digits (most significant first)
+  void intervalDigits(const Entry& e, uint64_t x, uint64_t y, uint64_t* digits) const;
+
+  std::vector<const MatrixSampler*> m_samplers;
+  uint64_t m_size = 0;
+  uint64_t m_base = 0;
+  //inverses modulo m_base of 1 .. m_base - 1
+  std::vector<uint64_t> m_inv;
+  //map columns: index bitmasks in base 2, d times the column packed for each digit d (see PackedDigits)
+  //when index digits fit a word, m_size index digits otherwise
+  PackedDigits m_packing;
+  std::vector<uint64_t> m_arena;
+  std::vector<Entry> m_entries;
+
+};
+
+/// Enumerates the indices of the points of two dimensions that fall in the elementary interval
+/// [x b^-k, (x+1) b^-k) x [y b^-l, (y+1) b^-l) (e.g. a pixel of a b^k x b^l image), without generating the
+/// other points (Grünschloß et al. 2012, "Enumerating quasi-Monte Carlo point sequences in elementary
+/// intervals"). The k (resp. l) first digits of a sample are the k first rows of its matrix times the index
+/// digits: the indices are the solutions of a (k + l) x m linear system over GF(b), solved by Gaussian
+/// elimination. Each of the b^(m - rank) solutions is one index, e.g. b^(m - k - l) for (0, m, 2)-nets.
+/// Applies to unscrambled samples. Repeated queries should use an IntervalIndexCache.
+/// @param dimX the sampler of the first dimension
+/// @param dimY the sampler of the second dimension (same size and base)
+/// @param k the resolution of the first dimension (b^k intervals, k <= m)
+/// @param l the resolution of the second dimension (b^l intervals, l <= m)
+/// @param x the interval in the first dimension (< b^k)
+/// @param y the interval in the second dimension (< b^l)
+/// @param indices the indices of the points in the interval, increasing (empty if there are none)
+/// @returns false if the arguments are invalid or the base is not prime
+bool getIntervalIndices(const MatrixSampler& dimX, const MatrixSampler& dimY, int k, int l, uint64_t x, uint64_t y,
+                        std::vector<uint64_t>& indices);
@@ -17,6 +17,7 @@ Copyright 2022, CNRS
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <iterator>
 #include <chrono>
 #include <galois++/field.h>
 #include "CLI11.hpp"
@@ -61,9 +62,16 @@ int main (int argc, const char** argv)
     app.add_flag("--debug", dbg_flag, "Toggles debug outputs");
     bool header = false;
     app.add_flag("--header", header, "Writes profile as comments at the beginning of matrix file");
+    bool binary = false;
+    app.add_flag("--binary", binary, "Writes matrices in binary format (compact, memory mapped by the sampler), requires -o");
 
     CLI11_PARSE(app, argc, argv);
 
+    if (binary && outfile == ""){
+        cerr << "Error: --binary requires an output file (-o)" << endl;
+        return -1;
+    }
+
     int tmpFullSize;
     int tmpBasis;
     int tmpS;
@@ -215,6 +223,17 @@ int main (int argc, const char** argv)
 
     if (outfile==""){
         writeMatrices(cout, fullSize, C, true);
+    } else if (binary){
+        ifstream file(filename);
+        string profile((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        MatrixFileHeader desc;
+        desc.base = b;
+        desc.m = fullSize;
+        desc.profileHash = hashProfile(profile);
+        if (!writeMatricesBinary(outfile, desc, C)){
+            cerr << "Error: Could not write output file: " << outfile << endl;
+            return -1;
+        }
     } else{
         ofstream out(outfile);
         if (header){
@@ -19,9 +19,91 @@ Copyright 2022, CNRS
 #include <vector>
 #include <bitset>
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 
 #include "MatrixSamplerClass.h"
 #include "Scrambling.h"
+#include "TargetClones.h"
+
+//Number of low index bits covered by MatrixSampler::m_lowBits
+static const uint64_t LOW_BITS = 8;
+
+/// out[i] = \p high ^ \p low[i] for i < \p count
+MATBUILDER_TARGET_CLONES
+static void xorBlock(uint64_t high, const uint64_t* low, size_t count, uint64_t* out) {
+    for (size_t i = 0; i < count; ++i){
+        out[i] = high ^ low[i];
+    }
+}
+
+/// out[i] = \p in[i] / \p scale for i < \p count
+MATBUILDER_TARGET_CLONES
+static void toDoubleBlock(const uint64_t* in, size_t count, double scale, double* out) {
+    for (size_t i = 0; i < count; ++i){
+        out[i] = double(in[i]) / scale;
+    }
+}
+
+/// Returns the n-th sample in base \p Base from packed columns (0 for a runtime base given by \p runtimeBase).
+/// @param packing the digits packing
+/// @param cols the packed columns multiples
+/// @param size the matrix size
+/// @param runtimeBase the basis (when \p Base is 0)
+/// @param n the index
+/// @returns the n-th int sample
+template<uint64_t Base>
+static uint64_t getIntPackedKernel(const PackedDigits& packing, const uint64_t* cols, uint64_t size, uint64_t runtimeBase,
+                                   uint64_t n) {
+    const uint64_t base = Base ? Base : runtimeBase;
+    uint64_t acc = 0;
+    //Remaining digits of n are 0 once n is 0
+    for (uint64_t col = 0; col < size && n != 0; ++col){
+        acc = packing.add(acc, cols[col * base + n % base]);
+        n /= base;
+    }
+    return packing.unpack(acc);
+}
+
+/// Returns the n-th sample in base \p Base (int version).
+/// \p Base is 0 for the generic implementation, which uses \p runtimeBase instead.
+/// @param mat the matrix
+/// @param size the matrix size
+/// @param runtimeBase the basis (when \p Base is 0)
+/// @param n the index
+/// @returns the n-th int sample
+template<uint64_t Base>
+static uint64_t getIntKernel(const int* mat, uint64_t size, uint64_t runtimeBase, uint64_t n) {
+    const uint64_t base = Base ? Base : runtimeBase;
+    assert(size <= 64);
+    std::array<uint64_t, 64> digits;
+    for (uint64_t i = 0; i < size; ++i){
+        digits[i] = n % base;
+        n /= base;
+    }
+    uint64_t result = 0;
+    for (uint64_t row = 0; row < size; ++row){
+        //Radical inverse: first row is the most significant digit
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < size; ++i){
+            total += digits[i] * uint64_t(mat[row * size + i]);
+        }
+        result = result * base + total % base;
+    }
+    return result;
+}
+
+/// Returns the getInt implementation compiled for base \p base
+/// @param base the basis
+MatrixSampler::IntKernel selectIntKernel(uint64_t base) {
+    switch (base) {
+        case 2: return &getIntKernel<2>;
+        case 3: return &getIntKernel<3>;
+        case 5: return &getIntKernel<5>;
+        case 7: return &getIntKernel<7>;
+        default: return &getIntKernel<0>;
+    }
+}
 
 MatrixSampler::MatrixSampler() {}
 
@@ -29,12 +111,79 @@ MatrixSampler::MatrixSampler(const std::vector<int>&mat, const uint64_t size, co
         m_m = mat;
         m_size = size;
         m_base = base;
+        m_kernel = selectIntKernel(base);
+        initBits();
+        initPacked();
 }
 
 void MatrixSampler::init(const std::vector<int>&mat, const uint64_t size, const uint64_t base) {
     m_m = mat;
     m_size = size;
     m_base = base;
+    m_kernel = selectIntKernel(base);
+    initBits();
+    initPacked();
+    disableLookupTables();
+}
+
+/// Builds the bitmask columns used by the base 2 fast path
+void MatrixSampler::initBits() {
+    m_bits.clear();
+    if (m_base != 2 || m_size > 64)
+        return;
+    m_bits.resize(m_size, 0);
+    for (uint64_t col = 0; col < m_size; ++col){
+        for (uint64_t row = 0; row < m_size; ++row){
+            if (m_m[row * m_size + col] & 1)
+                m_bits[col] |= uint64_t(1) << (m_size - 1 - row);
+        }
+    }
+    //Index i differs from i & (i-1) by its lowest set bit only
+    m_lowBits.assign(uint64_t(1) << std::min(m_size, LOW_BITS), 0);
+    for (uint64_t i = 1; i < m_lowBits.size(); ++i){
+        m_lowBits[i] = m_lowBits[i & (i - 1)] ^ m_bits[__builtin_ctzll(i)];
+    }
+}
+
+/// Builds the packed columns used by the packed digits path
+void MatrixSampler::initPacked() {
+    m_packedCols.clear();
+    if (m_base == 2 || !PackedDigits::fits(m_base, m_size))
+        return;
+    m_packing = PackedDigits(m_base, m_size);
+    m_packedCols.resize(m_size * m_base, 0);
+    for (uint64_t col = 0; col < m_size; ++col){
+        for (uint64_t d = 0; d < m_base; ++d){
+            uint64_t value = 0;
+            for (uint64_t row = 0; row < m_size; ++row){
+                value = value * m_base + (d * uint64_t(m_m[row * m_size + col])) % m_base;
+            }
+            m_packedCols[col * m_base + d] = m_packing.pack(value);
+        }
+    }
+}
+
+/// Returns the n-th sample using packed digit vectors
+/// @param n the index of sample to get
+uint64_t MatrixSampler::getIntPacked(uint64_t n) const {
+    switch (m_base) {
+        case 3: return getIntPackedKernel<3>(m_packing, m_packedCols.data(), m_size, m_base, n);
+        case 5: return getIntPackedKernel<5>(m_packing, m_packedCols.data(), m_size, m_base, n);
+        case 7: return getIntPackedKernel<7>(m_packing, m_packedCols.data(), m_size, m_base, n);
+        default: return getIntPackedKernel<0>(m_packing, m_packedCols.data(), m_size, m_base, n);
+    }
+}
+
+/// Returns the n-th sample in base 2: xor of the columns selected by the bits of \p n
+/// @param n the index of sample to get
+uint64_t MatrixSampler::getIntBase2(uint64_t n) const {
+    if (m_size < 64)
+        n &= (uint64_t(1) << m_size) - 1;
+    uint64_t result = 0;
+    for (; n; n &= n - 1){
+        result ^= m_bits[__builtin_ctzll(n)];
+    }
+    return result;
 }
 
 const std::vector<int>& MatrixSampler::getMat() const{
@@ -45,21 +194,129 @@ const std::vector<int>& MatrixSampler::getMat() const{
 /// @param n the index of sample to get
 uint64_t MatrixSampler::getInt(uint64_t n) const {
     assert(m_size <= 64);
-    std::array<uint64_t, 64> digits;
-    uint64_t current = 1;
-    for (int i = 0; i < m_size; ++i){
-        digits[i] = (n / current) % m_base;
-        current *= m_base;
+    if (m_lutDigits != 0)
+        return getIntLookup(n);
+    if (!m_bits.empty())
+        return getIntBase2(n);
+    if (!m_packedCols.empty())
+        return getIntPacked(n);
+    return m_kernel(m_m.data(), m_size, m_base, n);
+}
+
+/// Switches getInt to lookup table evaluation
+/// @param memoryBudget the maximum size of the tables in bytes
+/// @returns false (and lookup tables stay disabled) if even k = 1 does not fit in the budget
+bool MatrixSampler::enableLookupTables(size_t memoryBudget) {
+    disableLookupTables();
+    if (m_size == 0)
+        return false;
+    const uint64_t entrySize = m_bits.empty() && m_packedCols.empty() ? m_size * sizeof(uint8_t) : sizeof(uint64_t);
+    //Largest chunk size k such that ceil(m/k) tables of b^k entries fit in the budget
+    uint64_t digits = 0;
+    uint64_t entries = 1;
+    for (uint64_t k = 1; k <= m_size; ++k){
+        entries *= m_base;
+        const uint64_t chunks = (m_size + k - 1) / k;
+        if (double(chunks) * double(entries) * double(entrySize) > double(memoryBudget))
+            break;
+        digits = k;
     }
-    uint64_t result = 0;
-    for (int row = 0; row < m_size; ++row){
-        //Radical inverse is encoded in current
-        current /= m_base;
-        uint64_t total = 0;
-        for (int i = 0; i < m_size; ++i){
-            total += digits[i] * uint64_t(m_m[row * m_size + i]);
+    if (digits == 0)
+        return false;
+    m_lutDigits = digits;
+    m_lutEntries = uint64_t(round(pow(double(m_base), double(digits))));
+    const uint64_t chunks = (m_size + digits - 1) / digits;
+    if (!m_bits.empty()){
+        m_lutBits.assign(chunks * m_lutEntries, 0);
+        for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+            uint64_t* table = &m_lutBits[chunk * m_lutEntries];
+            for (uint64_t v = 1; v < m_lutEntries; ++v){
+                //v differs from v & (v-1) by its lowest set bit only
+                const uint64_t col = chunk * digits + __builtin_ctzll(v);
+                table[v] = table[v & (v - 1)] ^ (col < m_size ? m_bits[col] : 0);
+            }
+        }
+        return true;
+    }
+    if (!m_packedCols.empty()){
+        //Built in place: v is its leading digit d (weight b^j) plus a smaller entry
+        m_lutPacked.assign(chunks * m_lutEntries, 0);
+        for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+            uint64_t* table = &m_lutPacked[chunk * m_lutEntries];
+            uint64_t power = 1;
+            uint64_t col = chunk * digits;
+            for (uint64_t v = 1; v < m_lutEntries; ++v){
+                if (v == power * m_base){
+                    power = v;
+                    ++col;
+                }
+                const uint64_t d = v / power;
+                table[v] = col < m_size ? m_packing.add(table[v % power], m_packedCols[col * m_base + d])
+                                        : table[v % power];
+            }
+        }
+        return true;
+    }
+    m_lutRows.assign(chunks * m_lutEntries * m_size, 0);
+    for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+        for (uint64_t v = 0; v < m_lutEntries; ++v){
+            uint8_t* entry = &m_lutRows[(chunk * m_lutEntries + v) * m_size];
+            uint64_t value = v;
+            //Index digits beyond m_size have no column: they do not contribute
+            for (uint64_t col = chunk * digits; col < std::min(m_size, (chunk + 1) * digits); ++col){
+                const uint64_t digit = value % m_base;
+                value /= m_base;
+                for (uint64_t row = 0; row < m_size; ++row){
+                    entry[row] = uint8_t((entry[row] + digit * uint64_t(m_m[row * m_size + col])) % m_base);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/// Frees lookup tables and switches getInt back to direct evaluation
+void MatrixSampler::disableLookupTables() {
+    m_lutDigits = 0;
+    m_lutEntries = 0;
+    m_lutBits.clear();
+    m_lutPacked.clear();
+    m_lutRows.clear();
+}
+
+/// Returns the n-th sample from the lookup tables
+/// @param n the index of sample to get
+uint64_t MatrixSampler::getIntLookup(uint64_t n) const {
+    const uint64_t chunks = (m_size + m_lutDigits - 1) / m_lutDigits;
+    if (!m_lutBits.empty()){
+        uint64_t result = 0;
+        for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+            result ^= m_lutBits[chunk * m_lutEntries + (n & (m_lutEntries - 1))];
+            n >>= m_lutDigits;
         }
-        result += (total % m_base) * current;
+        return result;
+    }
+    if (!m_lutPacked.empty()){
+        uint64_t acc = 0;
+        for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+            acc = m_packing.add(acc, m_lutPacked[chunk * m_lutEntries + n % m_lutEntries]);
+            n /= m_lutEntries;
+        }
+        return m_packing.unpack(acc);
+    }
+    //Entries are reduced digits: summing at most 64 of them cannot overflow
+    std::array<uint32_t, 64> total;
+    std::fill(total.begin(), total.begin() + m_size, 0);
+    for (uint64_t chunk = 0; chunk < chunks; ++chunk){
+        const uint8_t* entry = &m_lutRows[(chunk * m_lutEntries + n % m_lutEntries) * m_size];
+        n /= m_lutEntries;
+        for (uint64_t row = 0; row < m_size; ++row){
+            total[row] += entry[row];
+        }
+    }
+    uint64_t result = 0;
+    for (uint64_t row = 0; row < m_size; ++row){
+        result = result * m_base + total[row] % m_base;
     }
     return result;
 }
@@ -78,6 +335,48 @@ double MatrixSampler::getDouble(uint64_t n) const {
     return double(res) / pow(double(m_base), m_size);
 }
 
+/// Computes the samples of indices \p first .. \p first + \p count - 1 (int version)
+/// @param first the index of the first sample
+/// @param count the number of samples
+/// @param out the output array (\p count values)
+void MatrixSampler::getIntBatch(uint64_t first, size_t count, uint64_t* out) const {
+    if (m_bits.empty()){
+        SequentialSampler sequence(*this, first);
+        for (size_t i = 0; i < count; ++i){
+            out[i] = sequence.getInt();
+            sequence.next();
+        }
+        return;
+    }
+    //Blocks of aligned consecutive indices share their high bits
+    const uint64_t blockSize = m_lowBits.size();
+    while (count > 0){
+        const uint64_t low = first & (blockSize - 1);
+        const size_t n = size_t(std::min<uint64_t>(count, blockSize - low));
+        xorBlock(getIntBase2(first - low), &m_lowBits[low], n, out);
+        first += n;
+        out += n;
+        count -= n;
+    }
+}
+
+/// Computes the samples of indices \p first .. \p first + \p count - 1 (double version)
+/// @param first the index of the first sample
+/// @param count the number of samples
+/// @param out the output array (\p count values)
+void MatrixSampler::getDoubleBatch(uint64_t first, size_t count, double* out) const {
+    const double scale = pow(double(m_base), m_size);
+    std::array<uint64_t, 256> ints;
+    while (count > 0){
+        const size_t n = std::min(count, ints.size());
+        getIntBatch(first, n, ints.data());
+        toDoubleBlock(ints.data(), n, scale, out);
+        first += n;
+        out += n;
+        count -= n;
+    }
+}
+
 ///Casts an index int -> double
 /// @param n the index of sample to get
 double MatrixSampler::toDouble(uint64_t n) const {
@@ -87,15 +386,45 @@ double MatrixSampler::toDouble(uint64_t n) const {
 
 /// Returns the n-th scrambled sample
 /// @param n the index of sample to get
-uint64_t MatrixSampler::getScrambledInt(uint64_t n, int seed, int depth) const {
-    uint64_t i = getInt(n) * uint64_t(pow(m_base, depth - m_size));
-    return owenScramble(i, seed, depth, m_base);
+/// @param legacy uses the original std::minstd_rand based Owen scrambling
+uint64_t MatrixSampler::getScrambledInt(uint64_t n, int seed, int depth, bool legacy) const {
+    assert(depth <= maxScrambleDepth(int(m_base)));
+    if (m_base == 2 && !legacy && depth >= int(m_size))
+        return owenScrambleBase2(getInt(n) << (depth - m_size), seed, depth);
+    return owenScrambleSample(getInt(n), seed, int(m_size), depth, int(m_base), legacy);
 }
 
-/// Returns the n-th scrambled sample
+/// Returns the n-th scrambled sample, at any depth
+/// @param n the index of sample to get
+/// @param legacy uses the original std::minstd_rand based Owen scrambling (depth digits must fit 64 bits)
+double MatrixSampler::getScrambledDouble(uint64_t n, int seed, int depth, bool legacy) const {
+    if (legacy)
+        return getScrambledInt(n, seed, depth, legacy) / pow(double(m_base), depth);
+    return owenScrambleSampleDouble(getInt(n), seed, int(m_size), depth, int(m_base));
+}
+
+/// Returns the n-th scrambled sample, at any depth
+/// @param n the index of sample to get
+float MatrixSampler::getScrambledFloat(uint64_t n, int seed, int depth) const {
+    return owenScrambleSampleFloat(getInt(n), seed, int(m_size), depth, int(m_base));
+}
+
+/// Returns the n-th sample of a shuffled sequence
+/// @param n the index of sample to get
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth
+uint64_t MatrixSampler::getShuffledInt(uint64_t n, int indexSeed, int seed, int depth) const {
+    return getScrambledInt(owenScramble(n, indexSeed, int(m_size), int(m_base)), seed, depth);
+}
+
+/// Returns the n-th sample of a shuffled sequence
 /// @param n the index of sample to get
-double MatrixSampler::getScrambledDouble(uint64_t n, int seed, int depth) const {
-    return getScrambledInt(n, seed, depth) / pow(double(m_base), depth);
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth
+double MatrixSampler::getShuffledDouble(uint64_t n, int indexSeed, int seed, int depth) const {
+    return getScrambledDouble(owenScramble(n, indexSeed, int(m_size), int(m_base)), seed, depth);
 }
 
 std::ostream &operator<<(std::ostream &out, const MatrixSampler &sampler) {
@@ -110,6 +439,116 @@ std::ostream &operator<<(std::ostream &out, const MatrixSampler &sampler) {
     return out;
 }
 
+SequentialSampler::SequentialSampler(const MatrixSampler& sampler, uint64_t start) :
+    m_sampler(&sampler), m_digits(sampler.m_size), m_state(sampler.m_size), m_cols(sampler.m_size * sampler.m_size) {
+    const uint64_t size = sampler.m_size;
+    if (!sampler.m_bits.empty()){
+        //Binary counter: going from n to n+1 flips bits 0..ctz(n+1)
+        m_carryBits.resize(size);
+        uint64_t acc = 0;
+        for (uint64_t i = 0; i < size; ++i){
+            acc ^= sampler.m_bits[i];
+            m_carryBits[i] = acc;
+        }
+        seek(start);
+        return;
+    }
+    if (!sampler.m_packedCols.empty()){
+        seek(start);
+        return;
+    }
+    for (uint64_t col = 0; col < size; ++col){
+        for (uint64_t row = 0; row < size; ++row){
+            m_cols[col * size + row] = uint64_t(sampler.m_m[row * size + col]);
+        }
+    }
+    seek(start);
+}
+
+/// Moves the generator on index \p n (full O(m^2) evaluation)
+/// @param n the new index
+void SequentialSampler::seek(uint64_t n) {
+    const uint64_t size = m_sampler->m_size;
+    const uint64_t base = m_sampler->m_base;
+    m_index = n;
+    if (!m_carryBits.empty()){
+        m_bits = m_sampler->getInt(n);
+        return;
+    }
+    for (uint64_t i = 0; i < size; ++i){
+        m_digits[i] = n % base;
+        n /= base;
+    }
+    if (!m_sampler->m_packedCols.empty()){
+        m_packed = m_sampler->m_packing.pack(m_sampler->getInt(m_index));
+        return;
+    }
+    for (uint64_t row = 0; row < size; ++row){
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < size; ++i){
+            total += m_digits[i] * m_cols[i * size + row];
+        }
+        m_state[row] = total % base;
+    }
+}
+
+/// Moves the generator on the next index
+void SequentialSampler::next() {
+    const uint64_t size = m_sampler->m_size;
+    const uint64_t base = m_sampler->m_base;
+    ++m_index;
+    if (!m_carryBits.empty()){
+        const uint64_t low = size < 64 ? m_index & ((uint64_t(1) << size) - 1) : m_index;
+        const uint64_t last = low == 0 ? size - 1 : uint64_t(__builtin_ctzll(low));
+        m_bits ^= m_carryBits[last];
+        return;
+    }
+    if (!m_sampler->m_packedCols.empty()){
+        const PackedDigits& packing = m_sampler->m_packing;
+        for (uint64_t i = 0; i < size; ++i){
+            m_packed = packing.add(m_packed, m_sampler->m_packedCols[i * base + 1]);
+            if (++m_digits[i] < base) break;
+            m_digits[i] = 0;
+        }
+        return;
+    }
+    //Incrementing a digit adds its column once, and so does wrapping it
+    //from b-1 to 0 (-(b-1) = 1 mod b): walk the carry chain adding columns
+    for (uint64_t i = 0; i < size; ++i){
+        const uint64_t* col = &m_cols[i * size];
+        for (uint64_t row = 0; row < size; ++row){
+            uint64_t v = m_state[row] + col[row];
+            m_state[row] = v >= base ? v - base : v;
+        }
+        if (++m_digits[i] < base) break;
+        m_digits[i] = 0;
+    }
+}
+
+/// Returns the index of the current sample
+uint64_t SequentialSampler::index() const {
+    return m_index;
+}
+
+/// Returns the current sample (int version)
+uint64_t SequentialSampler::getInt() const {
+    if (!m_carryBits.empty())
+        return m_bits;
+    if (!m_sampler->m_packedCols.empty())
+        return m_sampler->m_packing.unpack(m_packed);
+    const uint64_t base = m_sampler->m_base;
+    uint64_t result = 0;
+    for (uint64_t digit : m_state){
+        result = result * base + digit;
+    }
+    return result;
+}
+
+/// Returns the current sample (double version)
+double SequentialSampler::getDouble() const {
+    return m_sampler->toDouble(getInt());
+}
+
 
 /// Returns the n-th sample (int version)
 /// @param mat the matrix
@@ -118,24 +557,7 @@ std::ostream &operator<<(std::ostream &out, const MatrixSampler &sampler) {
 /// @param n the index
 /// @returns the n-th int sample
 uint64_t getInt(const std::vector<int>&mat, const uint64_t size, const uint64_t base, uint64_t n) {
-    assert(size <= 64);
-    std::array<uint64_t, 64> digits;
-    uint64_t current = 1;
-    for (int i = 0; i < size; ++i){
-        digits[i] = (n / current) % base;
-        current *= base;
-    }
-    uint64_t result = 0;
-    for (int row = 0; row < size; ++row){
-        //Radical inverse is encoded in current
-        current /= base;
-        uint64_t total = 0;
-        for (int i = 0; i < size; ++i){
-            total += digits[i] * uint64_t(mat[row * size + i]);
-        }
-        result += (total % base) * current;
-    }
-    return result;
+    return selectIntKernel(base)(mat.data(), size, base, n);
 }
 
 /// Returns the n-th sample (double version)
@@ -154,11 +576,12 @@ double getDouble(const std::vector<int>&mat, const uint64_t size, const uint64_t
 /// @param size the matrix size
 /// @param base the basis
 /// @param n the index
+/// @param legacy uses the original std::minstd_rand based Owen scrambling
 /// @returns the owen scrambled n-th int sample
 uint64_t getScrambledInt(const std::vector<int>&mat, const uint64_t size, const uint64_t base, uint64_t n, int seed,
-                         int depth) {
-    uint64_t i = getInt(mat, size, base, n) * uint64_t(pow(base, depth - size));
-    return owenScramble(i, seed, depth, base);
+                         int depth, bool legacy) {
+    assert(depth <= maxScrambleDepth(int(base)));
+    return owenScrambleSample(getInt(mat, size, base, n), seed, int(size), depth, int(base), legacy);
 }
 
 /// Returns the n-th sample (double version)
@@ -166,8 +589,39 @@ uint64_t getScrambledInt(const std::vector<int>&mat, const uint64_t size, const
 /// @param size the matrix size
 /// @param base the basis
 /// @param n the index
-/// @returns the owen scrambled n-th double sample
+/// @param legacy uses the original std::minstd_rand based Owen scrambling (depth digits must fit 64 bits)
+/// @returns the owen scrambled n-th double sample, at any depth
 double getScrambledDouble(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int seed,
-                          int depth) {
-    return getScrambledInt(mat, size, base, n, seed, depth) / pow(double(base), depth);
+                          int depth, bool legacy) {
+    if (legacy)
+        return getScrambledInt(mat, size, base, n, seed, depth, legacy) / pow(double(base), depth);
+    return owenScrambleSampleDouble(getInt(mat, size, base, n), seed, int(size), depth, int(base));
+}
+
+/// Returns the n-th sample of a shuffled sequence (int version)
+/// @param mat the matrix
+/// @param size the matrix size
+/// @param base the basis
+/// @param n the index
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth
+/// @returns the owen scrambled sample of the shuffled index n
+uint64_t getShuffledInt(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int indexSeed,
+                        int seed, int depth) {
+    return getScrambledInt(mat, size, base, owenScramble(n, indexSeed, int(size), int(base)), seed, depth);
+}
+
+/// Returns the n-th sample of a shuffled sequence (double version)
+/// @param mat the matrix
+/// @param size the matrix size
+/// @param base the basis
+/// @param n the index
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth
+/// @returns the owen scrambled sample of the shuffled index n
+double getShuffledDouble(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int indexSeed,
+                         int seed, int depth) {
+    return getScrambledDouble(mat, size, base, owenScramble(n, indexSeed, int(size), int(base)), seed, depth);
 }
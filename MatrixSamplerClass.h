@@ -22,6 +22,7 @@ Copyright 2022, CNRS
 #include <cassert>
 
 #include "Scrambling.h"
+#include "PackedDigits.h"
 
 class MatrixSampler {
 
@@ -31,6 +32,27 @@ public:
   uint64_t m_size;
   std::vector<int> m_m;
     uint64_t m_base;
+  //base 2 only: matrix columns as bitmasks (row r is stored in bit m_size-1-r)
+  std::vector<uint64_t> m_bits;
+  //base 2 only: samples of the indices 0..2^k-1 (k low bits), used by getIntBatch
+  std::vector<uint64_t> m_lowBits;
+
+  //other bases, when m_size digits fit in a word: m_packedCols[col * m_base + d] is d times column col, packed
+  PackedDigits m_packing;
+  std::vector<uint64_t> m_packedCols;
+  //lookup tables (see enableLookupTables): index digits are read by chunks of m_lutDigits digits,
+  //each chunk value selects the contribution of the chunk to the sample
+  uint64_t m_lutDigits = 0;
+  uint64_t m_lutEntries = 0;
+  //base 2: one bitmask per (chunk, value)
+  std::vector<uint64_t> m_lutBits;
+  //other bases: one packed digit vector per (chunk, value) when digits fit in a word, m_size digits otherwise
+  std::vector<uint64_t> m_lutPacked;
+  std::vector<uint8_t> m_lutRows;
+
+  /// getInt implementation specialized for a base, see selectIntKernel
+  typedef uint64_t (*IntKernel)(const int* mat, uint64_t size, uint64_t base, uint64_t n);
+  IntKernel m_kernel = nullptr;
 
   MatrixSampler();
 
@@ -44,6 +66,17 @@ public:
   /// @param n the index of sample to get
   uint64_t getInt(uint64_t n) const;
 
+  /// Switches getInt to lookup table evaluation: index digits are grouped by chunks of k digits and
+  /// a table per chunk stores the contribution of each of the b^k chunk values, so that a sample is
+  /// the digit-wise sum of ceil(m/k) table entries. k is the largest size for which all the tables
+  /// fit in \p memoryBudget bytes.
+  /// @param memoryBudget the maximum size of the tables in bytes
+  /// @returns false (and lookup tables stay disabled) if even k = 1 does not fit in the budget
+  bool enableLookupTables(size_t memoryBudget);
+
+  /// Frees lookup tables and switches getInt back to direct evaluation
+  void disableLookupTables();
+
   /// Returns the n-th sample as if matrix was of size \p m
   /// @param n the index of sample to get
   /// @param m the fake matrix size
@@ -53,6 +86,21 @@ public:
   /// @param n the index of sample to get
   double getDouble(uint64_t n) const;
 
+  /// Computes the samples of indices \p first .. \p first + \p count - 1 (int version).
+  /// In base 2 the samples of a block of consecutive indices are a precomputed table xored with the block
+  /// offset, evaluated with the widest SIMD instruction set available at runtime; other bases use
+  /// incremental generation (see SequentialSampler).
+  /// @param first the index of the first sample
+  /// @param count the number of samples
+  /// @param out the output array (\p count values)
+  void getIntBatch(uint64_t first, size_t count, uint64_t* out) const;
+
+  /// Computes the samples of indices \p first .. \p first + \p count - 1 (double version)
+  /// @param first the index of the first sample
+  /// @param count the number of samples
+  /// @param out the output array (\p count values)
+  void getDoubleBatch(uint64_t first, size_t count, double* out) const;
+
   ///Casts an index int -> double
   /// @param n the index of sample to get
   double toDouble(uint64_t n) const;
@@ -60,16 +108,114 @@ public:
 
   /// Returns the n-th scrambled sample
   /// @param n the index of sample to get
-  uint64_t getScrambledInt(uint64_t n, int seed, int depth) const;
+  /// @param depth the scrambling depth, at most maxScrambleDepth(m_base) (depth digits fit 64 bits),
+  /// see getScrambledDouble for deeper scrambling
+  /// @param legacy uses the original std::minstd_rand based Owen scrambling
+  uint64_t getScrambledInt(uint64_t n, int seed, int depth, bool legacy=false) const;
 
-  /// Returns the n-th scrambled sample
+  /// Returns the n-th scrambled sample, at any depth (see owenScrambleSampleDouble)
+  /// @param n the index of sample to get
+  /// @param legacy uses the original std::minstd_rand based Owen scrambling (depth digits must fit 64 bits)
+  double getScrambledDouble(uint64_t n, int seed, int depth, bool legacy=false) const;
+
+  /// Returns the n-th scrambled sample, at any depth (see owenScrambleSampleFloat)
+  /// @param n the index of sample to get
+  float getScrambledFloat(uint64_t n, int seed, int depth) const;
+
+  /// Returns the n-th sample of a shuffled sequence (Burley 2020): the m_size digits of \p n are Owen scrambled
+  /// with \p indexSeed before the sample is computed and Owen scrambled with \p seed. Using the same
+  /// \p indexSeed in all dimensions gives independent, still progressive, sequences for each \p indexSeed
+  /// (e.g. one per pixel): the first b^k indices map to an aligned block of b^k samples.
+  /// @param n the index of sample to get
+  /// @param indexSeed the seed of the index shuffling
+  /// @param seed the seed of the sample scrambling
+  /// @param depth the scrambling depth, at most maxScrambleDepth(m_base)
+  uint64_t getShuffledInt(uint64_t n, int indexSeed, int seed, int depth) const;
+
+  /// Returns the n-th sample of a shuffled sequence (see getShuffledInt)
   /// @param n the index of sample to get
-  double getScrambledDouble(uint64_t n, int seed, int depth) const;
+  /// @param indexSeed the seed of the index shuffling
+  /// @param seed the seed of the sample scrambling
+  /// @param depth the scrambling depth
+  double getShuffledDouble(uint64_t n, int indexSeed, int seed, int depth) const;
 
   friend std::ostream &operator<<(std::ostream &out, const MatrixSampler &sampler);
 
+private:
+
+  /// Builds the bitmask columns used by the base 2 fast path
+  void initBits();
+
+  /// Returns the n-th sample in base 2: xor of the columns selected by the bits of \p n
+  /// @param n the index of sample to get
+  uint64_t getIntBase2(uint64_t n) const;
+
+  /// Builds the packed columns used by the packed digits path
+  void initPacked();
+
+  /// Returns the n-th sample using packed digit vectors: sum of one packed column multiple per index digit
+  /// @param n the index of sample to get
+  uint64_t getIntPacked(uint64_t n) const;
+
+  /// Returns the n-th sample from the lookup tables
+  /// @param n the index of sample to get
+  uint64_t getIntLookup(uint64_t n) const;
+
 };
 
+/// Sequential generator over the samples of a MatrixSampler.
+/// Keeps the base-b digits of the current index and the output digits of the
+/// current sample: moving to the next index only adds one matrix column per
+/// changed index digit, hence O(m) amortized per sample instead of O(m^2).
+class SequentialSampler {
+
+public:
+
+  /// Creates a generator positioned on index \p start
+  /// @param sampler the sampler to walk (must outlive the generator)
+  /// @param start the first index
+  SequentialSampler(const MatrixSampler& sampler, uint64_t start = 0);
+
+  /// Moves the generator on index \p n (full O(m^2) evaluation)
+  /// @param n the new index
+  void seek(uint64_t n);
+
+  /// Moves the generator on the next index
+  void next();
+
+  /// Returns the index of the current sample
+  uint64_t index() const;
+
+  /// Returns the current sample (int version), same as MatrixSampler::getInt(index())
+  uint64_t getInt() const;
+
+  /// Returns the current sample (double version), same as MatrixSampler::getDouble(index())
+  double getDouble() const;
+
+private:
+
+  const MatrixSampler* m_sampler;
+  uint64_t m_index;
+  //Digits of the index, least significant first
+  std::vector<uint64_t> m_digits;
+  //Digits of the current sample, most significant first (matrix row order)
+  std::vector<uint64_t> m_state;
+  //Matrix stored column by column
+  std::vector<uint64_t> m_cols;
+  //base 2 only: current sample and xor of columns 0..i for each i
+  uint64_t m_bits;
+  std::vector<uint64_t> m_carryBits;
+  //packed digits only: current sample digits, packed
+  uint64_t m_packed;
+
+};
+
+/// Returns the getInt implementation compiled for base \p base.
+/// Bases 2, 3, 5 and 7 get a compile-time base (divisions and modulos are strength-reduced),
+/// other bases fall back to the generic runtime-base implementation.
+/// @param base the basis
+MatrixSampler::IntKernel selectIntKernel(uint64_t base);
+
 /// Returns the n-th sample (int version)
 /// @param mat the matrix
 /// @param size the matrix size
@@ -91,15 +237,42 @@ double getDouble(const std::vector<int>&mat, const uint64_t size, const uint64_t
 /// @param size the matrix size
 /// @param base the basis
 /// @param n the index
+/// @param depth the scrambling depth, at most maxScrambleDepth(base) (depth digits fit 64 bits)
+/// @param legacy uses the original std::minstd_rand based Owen scrambling
 /// @returns the owen scrambled n-th int sample
 uint64_t getScrambledInt(const std::vector<int>&mat, const uint64_t size, const uint64_t base, uint64_t n, int seed,
-                         int depth);
+                         int depth, bool legacy=false);
 
 /// Returns the n-th sample (double version)
 /// @param mat the matrix
 /// @param size the matrix size
 /// @param base the basis
 /// @param n the index
-/// @returns the owen scrambled n-th double sample
+/// @param legacy uses the original std::minstd_rand based Owen scrambling (depth digits must fit 64 bits)
+/// @returns the owen scrambled n-th double sample, at any depth
 double getScrambledDouble(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int seed,
-                          int depth);
+                          int depth, bool legacy=false);
+
+/// Returns the n-th sample of a shuffled sequence (int version, see MatrixSampler::getShuffledInt)
+/// @param mat the matrix
+/// @param size the matrix size
+/// @param base the basis
+/// @param n the index
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth, at most maxScrambleDepth(base)
+/// @returns the owen scrambled sample of the shuffled index n
+uint64_t getShuffledInt(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int indexSeed,
+                        int seed, int depth);
+
+/// Returns the n-th sample of a shuffled sequence (double version, see MatrixSampler::getShuffledInt)
+/// @param mat the matrix
+/// @param size the matrix size
+/// @param base the basis
+/// @param n the index
+/// @param indexSeed the seed of the index shuffling
+/// @param seed the seed of the sample scrambling
+/// @param depth the scrambling depth
+/// @returns the owen scrambled sample of the shuffled index n
+double getShuffledDouble(const std::vector<int>& mat, const uint64_t size, const uint64_t base, uint64_t n, int indexSeed,
+                         int seed, int depth);
@@ -13,11 +13,25 @@ Copyright 2022, CNRS
    See the License for the specific language governing permissions and
    limitations under the License.
 */
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <fstream>
+#include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "MatrixTools.h"
 
+//Binary matrix files
+static const char MATRIX_MAGIC[8] = {'M', 'B', 'M', 'A', 'T', 'R', 'I', 'X'};
+static const uint32_t MATRIX_VERSION = 1;
+static const size_t MATRIX_HEADER_SIZE = 64;
+
 
 /// Returns the index in 1D tab for position (\p row, \p col)
 /// @param row the row index
@@ -86,24 +100,239 @@ void readMatrix(std::istream& in, int m, std::vector<int>& B){
 }
 
 
-/// Reads matrices \p B from \p in
-/// @param in the input stream
+/// Reads the remaining of \p in in \p text, in a single read when the stream size is known
+static void slurp(std::istream& in, std::string& text){
+  const std::streampos start = in.tellg();
+  if (start != std::streampos(-1) && in.seekg(0, std::ios::end)){
+    const std::streampos stop = in.tellg();
+    in.seekg(start);
+    text.resize(size_t(stop - start));
+    in.read(&text[0], text.size());
+    text.resize(size_t(in.gcount()));
+  } else {
+    in.clear();
+    std::ostringstream content;
+    content << in.rdbuf();
+    text = content.str();
+  }
+}
+
+/// Parses \p s matrices of size \p m from \p text: whitespace separated digits, m x m per matrix row after row
+/// whatever the line breaks inside a matrix, each matrix ending with a line; # comments are skipped
+/// @param text the text to parse
 /// @param m the matrices size
-/// @param B the matrices
-void readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>& B){
+/// @param s the number of matrices to read
+/// @param B the output matrices
+/// @param base if not 0, the digits are checked to be in [0, base)
+/// @returns false (with the line of the error on std::cerr) if the text is malformed or has less than \p s matrices
+static bool parseMatrices(const std::string& text, int m, int s, std::vector<std::vector<int>>& B, int base){
+  B.assign(s, std::vector<int>(m * m));
+  const char* p = text.data();
+  const char* end = p + text.size();
+  const int size = m * m;
+  int line = 1;
   int sampler = 0;
-  while(sampler < s && !in.eof()){
-    char c;
-    in >> c;
-    if (c == '#') {
-      std::string line;
-      getline(in, line);
+  int count = 0;
+  while (sampler < s && p != end){
+    if (*p == '\n'){
+      ++line;
+      ++p;
       continue;
     }
-    in.putback(c);
-    readMatrix(in, m, B[sampler]);
-    sampler += 1;
+    if (std::isspace((unsigned char)*p)){
+      ++p;
+      continue;
+    }
+    if (*p == '#'){
+      while (p != end && *p != '\n') ++p;
+      continue;
+    }
+    int value;
+    const std::from_chars_result res = std::from_chars(p, end, value);
+    if (res.ec != std::errc() || (res.ptr != end && !std::isspace((unsigned char)*res.ptr) && *res.ptr != '#')){
+      const char* token = p;
+      while (p != end && !std::isspace((unsigned char)*p)) ++p;
+      std::cerr << "Error Parsing: line " << line << ": invalid value '" << std::string(token, p) << "'" << std::endl;
+      return false;
+    }
+    if (value < 0 || (base != 0 && value >= base)){
+      std::cerr << "Error Parsing: line " << line << ": value " << value << " is not a digit in base " << base << std::endl;
+      return false;
+    }
+    B[sampler][count] = value;
+    p = res.ptr;
+    if (++count == size){
+      //A matrix ends with its line: values after it on the same line mean a wrong matrix size or a malformed line
+      while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+      if (p != end && *p != '\n' && *p != '#'){
+        const char* token = p;
+        while (p != end && !std::isspace((unsigned char)*p)) ++p;
+        std::cerr << "Error Parsing: line " << line << ": '" << std::string(token, p) << "' after the " << size
+                  << " values of matrix " << sampler << ", matrices of size " << m << " must end with a line" << std::endl;
+        return false;
+      }
+      count = 0;
+      ++sampler;
+    }
+  }
+  if (sampler < s){
+    std::cerr << "Error Parsing: line " << line << ": end of input after " << sampler << " matrices";
+    if (count != 0) std::cerr << " and " << count << " values";
+    std::cerr << ", " << s << " matrices of size " << m << " expected" << std::endl;
+    return false;
   }
+  return true;
+}
+
+/// Reads \p s matrices \p B from \p in
+/// @param in the input stream
+/// @param m the matrices size
+/// @param s the number of matrices to read
+/// @param B the output matrices
+/// @param base if not 0, the digits are checked to be in [0, base)
+/// @returns false (with the line of the error on std::cerr) if the input is malformed or has less than \p s matrices
+bool readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>& B, int base){
+  std::string text;
+  slurp(in, text);
+  return parseMatrices(text, m, s, B, base);
+}
+
+/// Returns the 64 bits FNV-1a hash of \p data
+/// @param data the data to hash
+uint64_t hashProfile(const std::string& data){
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : data){
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/// Returns the number of bits used to store a digit in base \p base
+static int bitsPerDigit(int base){
+  int bits = 1;
+  while ((1 << bits) < base) ++bits;
+  return bits;
+}
+
+/// Stores the \p bytes low bytes of \p v at \p dst, least significant first
+static void storeLE(unsigned char* dst, uint64_t v, int bytes){
+  for (int i = 0; i < bytes; ++i){
+    dst[i] = (unsigned char)((v >> (8 * i)) & 0xff);
+  }
+}
+
+/// Loads \p bytes bytes stored at \p src, least significant first
+static uint64_t loadLE(const unsigned char* src, int bytes){
+  uint64_t v = 0;
+  for (int i = bytes - 1; i >= 0; --i){
+    v = (v << 8) | src[i];
+  }
+  return v;
+}
+
+/// Writes matrices \p B in binary format in file \p fname
+/// @param fname the file name
+/// @param header the matrices description (s is taken from \p B)
+/// @param B the matrices
+/// @returns false if the file could not be written
+bool writeMatricesBinary(const std::string& fname, const MatrixFileHeader& header, const std::vector<std::vector<int>>& B){
+  const int bits = bitsPerDigit(header.base);
+  const uint64_t nbDigits = uint64_t(B.size()) * header.m * header.m;
+  std::vector<unsigned char> data(MATRIX_HEADER_SIZE + (nbDigits * bits + 7) / 8, 0);
+  std::copy(MATRIX_MAGIC, MATRIX_MAGIC + 8, data.begin());
+  storeLE(&data[8], MATRIX_VERSION, 4);
+  storeLE(&data[12], header.base, 4);
+  storeLE(&data[16], header.m, 4);
+  storeLE(&data[20], B.size(), 4);
+  storeLE(&data[24], header.cStyle ? 0 : 1, 4);
+  storeLE(&data[28], bits, 4);
+  storeLE(&data[32], header.profileHash, 8);
+  uint64_t bit = 0;
+  for (const std::vector<int>& b : B){
+    for (int i = 0; i < header.m * header.m; ++i){
+      for (int k = 0; k < bits; ++k, ++bit){
+        if ((b[i] >> k) & 1)
+          data[MATRIX_HEADER_SIZE + bit / 8] |= (unsigned char)(1 << (bit % 8));
+      }
+    }
+  }
+  std::ofstream out(fname, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return bool(out);
+}
+
+/// Tests whether file \p fname is a binary matrix file
+/// @param fname the file name
+bool isBinaryMatrixFile(const std::string& fname){
+  std::ifstream in(fname, std::ios::binary);
+  char magic[8];
+  return in.read(magic, 8) && std::equal(magic, magic + 8, MATRIX_MAGIC);
+}
+
+/// Reads the binary matrix file \p fname (memory mapped)
+/// @param fname the file name
+/// @param header the matrices description read from the file
+/// @param s the number of matrices to read (all if negative)
+/// @param B the output matrices
+/// @returns false (with a message on std::cerr) if the file is invalid or has less than \p s matrices
+bool readMatricesBinary(const std::string& fname, MatrixFileHeader& header, int s, std::vector<std::vector<int>>& B){
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0){
+    std::cerr << "Error: Could not open matrix file: " << fname << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < MATRIX_HEADER_SIZE){
+    std::cerr << "Error: Truncated matrix file: " << fname << std::endl;
+    close(fd);
+    return false;
+  }
+  const size_t size = size_t(st.st_size);
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED){
+    std::cerr << "Error: Could not map matrix file: " << fname << std::endl;
+    return false;
+  }
+  const unsigned char* data = static_cast<const unsigned char*>(mapped);
+  bool ok = std::equal(data, data + 8, MATRIX_MAGIC) && loadLE(&data[8], 4) == MATRIX_VERSION;
+  if (!ok){
+    std::cerr << "Error: Not a version " << MATRIX_VERSION << " binary matrix file: " << fname << std::endl;
+  } else {
+    header.base = int(loadLE(&data[12], 4));
+    header.m = int(loadLE(&data[16], 4));
+    header.s = int(loadLE(&data[20], 4));
+    header.cStyle = loadLE(&data[24], 4) == 0;
+    header.profileHash = loadLE(&data[32], 8);
+    const int bits = int(loadLE(&data[28], 4));
+    //Fields are checked before sizes are computed from them: negative values must not wrap
+    const bool validHeader = header.base >= 2 && header.base <= (1 << 16) && bits == bitsPerDigit(header.base)
+                             && header.m > 0 && header.m <= 64 && header.s >= 0;
+    const uint64_t nbDigits = validHeader ? uint64_t(header.s) * header.m * header.m : 0;
+    if (!validHeader || size < MATRIX_HEADER_SIZE + (nbDigits * bits + 7) / 8){
+      std::cerr << "Error: Corrupted binary matrix file: " << fname << std::endl;
+      ok = false;
+    } else if ((s < 0 ? header.s : s) > header.s){
+      std::cerr << "Error: " << fname << " contains " << header.s << " matrices, " << s << " requested" << std::endl;
+      ok = false;
+    } else {
+      if (s < 0) s = header.s;
+      const unsigned char* digits = data + MATRIX_HEADER_SIZE;
+      B.assign(s, std::vector<int>(header.m * header.m));
+      uint64_t bit = 0;
+      for (std::vector<int>& b : B){
+        for (int& v : b){
+          v = 0;
+          for (int k = 0; k < bits; ++k, ++bit){
+            v |= ((digits[bit / 8] >> (bit % 8)) & 1) << k;
+          }
+        }
+      }
+    }
+  }
+  munmap(mapped, size);
+  return ok;
 }
 
 /// Initializes multiple MatrixSampler from stream \p in containing B style cascaded matrices
@@ -114,54 +343,29 @@ void readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>&
 /// @param b the basis of matrices
 /// @param Cs the output samplers
 /// @param cStyle toggles off multiplication
-void initSamplersFromStream(std::istream& in, int m, int nDims, int b, std::vector<MatrixSampler>& Cs, bool cStyle) {
-  std::vector<int> C(m*m);
-  Cs.reserve(nDims);
+bool initSamplersFromStream(std::istream& in, int m, int nDims, int b, std::vector<MatrixSampler>& Cs, bool cStyle) {
+  std::vector<std::vector<int>> Ms;
+  if (!readMatrices(in, m, nDims, Ms, b))
+    return false;
+  Cs.reserve(Cs.size() + nDims);
 
   if (cStyle){
-    //Read C and push back_sampler
-    int sampler = 0;
-    while(sampler < nDims && !in.eof()){
-      char c;
-      in >> c;
-      if (c == '#') {
-        std::string line;
-        getline(in, line);
-        continue;
-      }
-      in.putback(c);
-      readMatrix(in, m, C);
+    for (const std::vector<int>& C : Ms){
       Cs.emplace_back(C, m, b);
-      sampler += 1;
     }
   } else {
-    std::vector<int> B(m*m);
-    std::vector<int> prev(m*m);
-    for (int i =0; i < m; ++i) {
-      for (int j = 0; j < m; ++j) {
-        prev[index(i,j,m)] = 0;
-      }
-    }
+    std::vector<int> C(m*m);
+    std::vector<int> prev(m*m, 0);
     for (int i =0; i < m; ++i){
       prev[index(i,i,m)] = 1;
     }
-    int sampler = 0;
-    while(sampler < nDims && !in.eof()){
-      char c;
-      in >> c;
-      if (c == '#') {
-        std::string line;
-        getline(in, line);
-        continue;
-      }
-      in.putback(c);
-      readMatrix(in, m, B);
+    for (const std::vector<int>& B : Ms){
       matmult(B, prev, C, m, b);
       Cs.emplace_back(C, m, b);
       prev = C;
-      sampler += 1;
     }
   }
+  return true;
 }
 
 /// Computes newC = B . prevC
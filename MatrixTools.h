@@ -63,11 +63,52 @@ void writeMatrices(std::ostream& out, int m, const std::vector<std::vector<int>>
 void readMatrix(std::istream& in, int m, std::vector<int>& B);
 
 
-/// Reads matrices \p B from \p in
+/// Reads \p s matrices \p B from \p in (text format: whitespace separated digits, row after row, line breaks
+/// are free inside a matrix but each matrix ends with a line; # starts a comment up to the end of the line).
+/// The remaining of the stream is read at once and parsed in place.
 /// @param in the input stream
 /// @param m the matrices size
+/// @param s the number of matrices to read
+/// @param B the output matrices
+/// @param base if not 0, the digits are checked to be in [0, base)
+/// @returns false (with the line of the error on std::cerr) if the input is malformed or has less than \p s matrices
+bool readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>& B, int base=0);
+
+/// Content description of a binary matrix file
+struct MatrixFileHeader {
+  int base = 0;
+  int m = 0;
+  int s = 0;
+  bool cStyle = true;
+  uint64_t profileHash = 0;
+};
+
+/// Returns the 64 bits FNV-1a hash of \p data (used to identify the profile matrices were built from)
+/// @param data the data to hash
+uint64_t hashProfile(const std::string& data);
+
+/// Writes matrices \p B in binary format in file \p fname.
+/// Layout (little-endian): 64 bytes header
+///   char[8] magic "MBMATRIX", uint32 version (1), uint32 base, uint32 m, uint32 s, uint32 style (0: C, 1: B),
+///   uint32 bits per digit, uint64 profile hash, zero padding
+/// followed by the s matrices, row after row, each digit on ceil(log2(base)) bits (least significant bits first)
+/// @param fname the file name
+/// @param header the matrices description (s is taken from \p B)
 /// @param B the matrices
-void readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>& B);
+/// @returns false if the file could not be written
+bool writeMatricesBinary(const std::string& fname, const MatrixFileHeader& header, const std::vector<std::vector<int>>& B);
+
+/// Tests whether file \p fname is a binary matrix file
+/// @param fname the file name
+bool isBinaryMatrixFile(const std::string& fname);
+
+/// Reads the binary matrix file \p fname (memory mapped).
+/// @param fname the file name
+/// @param header the matrices description read from the file
+/// @param s the number of matrices to read (all if negative)
+/// @param B the output matrices
+/// @returns false (with a message on std::cerr) if the file is invalid or has less than \p s matrices
+bool readMatricesBinary(const std::string& fname, MatrixFileHeader& header, int s, std::vector<std::vector<int>>& B);
 
 /// Initializes multiple MatrixSampler from stream \p in containing B style cascaded matrices
 /// Use \p cStyle to true to skip matrices sequential multiplication
@@ -77,7 +118,8 @@ void readMatrices(std::istream& in, int m, int s, std::vector<std::vector<int>>&
 /// @param b the basis of matrices
 /// @param Cs the output samplers
 /// @param cStyle toggles off multiplication
-void initSamplersFromStream(std::istream& in, int m, int nDims, int b, std::vector<MatrixSampler>& Cs, bool cStyle=false);
+/// @returns false (with the line of the error on std::cerr) if the input is malformed or has less than \p nDims matrices
+bool initSamplersFromStream(std::istream& in, int m, int nDims, int b, std::vector<MatrixSampler>& Cs, bool cStyle=false);
 
 /// Computes newC = B . prevC
 /// @param m the matrix size
@@ -0,0 +1,91 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstdint>
+
+/// Digit vectors packed in a 64 bits word, for digit-wise arithmetic modulo b without branches (SWAR).
+/// Digit i (coefficient of b^i) is stored in bits [i*w, (i+1)*w) with w = 1 + ceil(log2(b)): the extra bit
+/// holds the carry of a digit-wise addition, which is then reduced modulo b in all the fields at once.
+/// e.g. 3 bits per digit in base 3 (21 digits), 4 bits per digit in bases 5 and 7 (16 digits).
+class PackedDigits {
+
+public:
+
+  uint64_t m_base = 0;
+  uint64_t m_size = 0;
+  uint64_t m_width = 0;
+  //lowest bit of each field
+  uint64_t m_ones = 0;
+  //highest bit of each field
+  uint64_t m_high = 0;
+  //2^(w-1) - b in each field: field + m_bias has its high bit set iff field >= b
+  uint64_t m_bias = 0;
+
+  PackedDigits() {}
+
+  /// Packing of \p size digits in base \p base (see fits)
+  PackedDigits(uint64_t base, uint64_t size) : m_base(base), m_size(size), m_width(fieldWidth(base)) {
+    for (uint64_t i = 0; i < m_size; ++i){
+      m_ones |= uint64_t(1) << (i * m_width);
+    }
+    m_high = m_ones << (m_width - 1);
+    m_bias = m_ones * ((uint64_t(1) << (m_width - 1)) - m_base);
+  }
+
+  /// Returns the number of bits per digit in base \p base
+  static uint64_t fieldWidth(uint64_t base) {
+    uint64_t width = 1;
+    while ((uint64_t(1) << (width - 1)) < base) ++width;
+    return width;
+  }
+
+  /// Tests whether \p size digits in base \p base fit in a word
+  static bool fits(uint64_t base, uint64_t size) {
+    return base >= 2 && size * fieldWidth(base) <= 64;
+  }
+
+  /// Returns the digit-wise sum of \p x and \p y modulo b
+  uint64_t add(uint64_t x, uint64_t y) const {
+    const uint64_t sum = x + y;
+    const uint64_t over = ((sum + m_bias) & m_high) >> (m_width - 1);
+    return sum - over * m_base;
+  }
+
+  /// Returns digit \p i of \p x
+  uint64_t digit(uint64_t x, uint64_t i) const {
+    return (x >> (i * m_width)) & ((uint64_t(1) << m_width) - 1);
+  }
+
+  /// Packs the digits of integer \p v (least significant digit in field 0)
+  uint64_t pack(uint64_t v) const {
+    uint64_t x = 0;
+    for (uint64_t i = 0; i < m_size; ++i){
+      x |= (v % m_base) << (i * m_width);
+      v /= m_base;
+    }
+    return x;
+  }
+
+  /// Returns the integer whose digits are packed in \p x
+  uint64_t unpack(uint64_t x) const {
+    uint64_t v = 0;
+    for (uint64_t i = m_size; i-- > 0;){
+      v = v * m_base + digit(x, i);
+    }
+    return v;
+  }
+
+};
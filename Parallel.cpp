@@ -0,0 +1,126 @@
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Parallel.h"
+
+/// Returns the number of threads to use for a requested count (0 means all available)
+/// @param nbThreads the requested number of threads
+int resolveThreads(int nbThreads) {
+    if (nbThreads > 0)
+        return nbThreads;
+    return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+/// Runs \p task(0) .. \p task(\p nbTasks - 1) on \p nbThreads threads, in no particular order
+/// @param nbThreads the number of threads
+/// @param nbTasks the number of tasks
+/// @param task the task function
+void parallelFor(int nbThreads, size_t nbTasks, const std::function<void(size_t)>& task) {
+    nbThreads = int(std::min<size_t>(resolveThreads(nbThreads), nbTasks));
+    if (nbThreads <= 1){
+        for (size_t i = 0; i < nbTasks; ++i){
+            task(i);
+        }
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nbThreads; ++t){
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < nbTasks; i = next++){
+                task(i);
+            }
+        });
+    }
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+/// Runs \p generate(c, buffer) for chunks c = 0 .. \p nbChunks - 1 on \p nbThreads threads and calls
+/// \p write(buffer) on the calling thread in chunk order
+/// @param nbThreads the number of threads
+/// @param nbChunks the number of chunks
+/// @param generate fills the buffer of a chunk (the buffer is cleared before)
+/// @param write consumes the buffers in order
+void parallelOrdered(int nbThreads, size_t nbChunks, const std::function<void(size_t, std::string&)>& generate,
+                     const std::function<void(const std::string&)>& write) {
+    nbThreads = int(std::min<size_t>(resolveThreads(nbThreads), nbChunks));
+    if (nbThreads <= 1){
+        std::string buffer;
+        for (size_t c = 0; c < nbChunks; ++c){
+            buffer.clear();
+            generate(c, buffer);
+            write(buffer);
+        }
+        return;
+    }
+    //Chunk c is stored in slot c % window until written
+    const size_t window = 4 * size_t(nbThreads);
+    std::vector<std::string> slots(window);
+    std::vector<bool> ready(window, false);
+    size_t next = 0;
+    size_t written = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nbThreads; ++t){
+        threads.emplace_back([&]() {
+            std::string buffer;
+            while (true) {
+                size_t c;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return next >= nbChunks || next < written + window; });
+                    if (next >= nbChunks)
+                        return;
+                    c = next++;
+                }
+                buffer.clear();
+                generate(c, buffer);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::swap(slots[c % window], buffer);
+                    ready[c % window] = true;
+                }
+                cv.notify_all();
+            }
+        });
+    }
+
+    std::string buffer;
+    while (written < nbChunks) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return bool(ready[written % window]); });
+            std::swap(slots[written % window], buffer);
+            ready[written % window] = false;
+            ++written;
+        }
+        cv.notify_all();
+        write(buffer);
+    }
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/// Returns the number of threads to use for a requested count (0 means all available)
+/// @param nbThreads the requested number of threads
+int resolveThreads(int nbThreads);
+
+/// Runs \p task(0) .. \p task(\p nbTasks - 1) on \p nbThreads threads, in no particular order
+/// @param nbThreads the number of threads
+/// @param nbTasks the number of tasks
+/// @param task the task function
+void parallelFor(int nbThreads, size_t nbTasks, const std::function<void(size_t)>& task);
+
+/// Runs \p generate(c, buffer) for chunks c = 0 .. \p nbChunks - 1 on \p nbThreads threads and calls
+/// \p write(buffer) on the calling thread in chunk order. Workers stay at most a few chunks ahead
+/// of the writer, so memory use does not depend on \p nbChunks.
+/// @param nbThreads the number of threads
+/// @param nbChunks the number of chunks
+/// @param generate fills the buffer of a chunk (the buffer is cleared before)
+/// @param write consumes the buffers in order
+void parallelOrdered(int nbThreads, size_t nbChunks, const std::function<void(size_t, std::string&)>& generate,
+                     const std::function<void(const std::string&)>& write);
@@ -0,0 +1,301 @@
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <array>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "PointSetSampler.h"
+
+//Size of the stack accumulator used by getIntPoint (dimensions are processed by groups)
+static const uint64_t ACC_SIZE = 1024;
+
+PointSetSampler::PointSetSampler() {}
+
+PointSetSampler::PointSetSampler(const std::vector<std::vector<int>>& mats, const uint64_t size, const uint64_t base) {
+    init(mats, size, base);
+}
+
+void PointSetSampler::init(const std::vector<std::vector<int>>& mats, const uint64_t size, const uint64_t base) {
+    assert(size <= 64);
+    m_size = size;
+    m_base = base;
+    m_dims = mats.size();
+    m_cols.resize(m_size * m_dims * m_size);
+    for (uint64_t col = 0; col < m_size; ++col){
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            for (uint64_t row = 0; row < m_size; ++row){
+                m_cols[(col * m_dims + dim) * m_size + row] = uint32_t(mats[dim][row * m_size + col]);
+            }
+        }
+    }
+    m_bits.clear();
+    if (m_base == 2){
+        m_bits.resize(m_size * m_dims, 0);
+        for (uint64_t col = 0; col < m_size; ++col){
+            for (uint64_t dim = 0; dim < m_dims; ++dim){
+                for (uint64_t row = 0; row < m_size; ++row){
+                    if (m_cols[(col * m_dims + dim) * m_size + row] & 1)
+                        m_bits[col * m_dims + dim] |= uint64_t(1) << (m_size - 1 - row);
+                }
+            }
+        }
+    }
+    m_packed.clear();
+    if (m_base != 2 && PackedDigits::fits(m_base, m_size)){
+        m_packing = PackedDigits(m_base, m_size);
+        m_packed.resize(m_size * m_base * m_dims);
+        for (uint64_t col = 0; col < m_size; ++col){
+            for (uint64_t d = 0; d < m_base; ++d){
+                for (uint64_t dim = 0; dim < m_dims; ++dim){
+                    const uint32_t* column = &m_cols[(col * m_dims + dim) * m_size];
+                    uint64_t value = 0;
+                    for (uint64_t row = 0; row < m_size; ++row){
+                        value = value * m_base + (d * column[row]) % m_base;
+                    }
+                    m_packed[(col * m_base + d) * m_dims + dim] = m_packing.pack(value);
+                }
+            }
+        }
+    }
+}
+
+/// Returns the number of dimensions
+uint64_t PointSetSampler::getDims() const {
+    return m_dims;
+}
+
+/// Computes the n-th point (int version)
+/// @param n the index of the point
+/// @param out the output coordinates (m_dims values)
+/// @param shifts if not null, the digit shift of each dimension (m_dims values of m_size digits)
+void PointSetSampler::getIntPoint(uint64_t n, uint64_t* out, const uint64_t* shifts) const {
+    if (!m_bits.empty()){
+        if (m_size < 64)
+            n &= (uint64_t(1) << m_size) - 1;
+        if (shifts)
+            std::copy(shifts, shifts + m_dims, out);
+        else
+            std::fill(out, out + m_dims, 0);
+        for (; n; n &= n - 1){
+            const uint64_t* col = &m_bits[__builtin_ctzll(n) * m_dims];
+            for (uint64_t dim = 0; dim < m_dims; ++dim){
+                out[dim] ^= col[dim];
+            }
+        }
+        return;
+    }
+    //Index digits are shared by all dimensions
+    std::array<uint32_t, 64> digits;
+    for (uint64_t i = 0; i < m_size; ++i){
+        digits[i] = uint32_t(n % m_base);
+        n /= m_base;
+    }
+    if (!m_packed.empty()){
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            out[dim] = shifts ? m_packing.pack(shifts[dim]) : 0;
+        }
+        for (uint64_t col = 0; col < m_size; ++col){
+            if (digits[col] == 0) continue;
+            const uint64_t* block = &m_packed[(col * m_base + digits[col]) * m_dims];
+            for (uint64_t dim = 0; dim < m_dims; ++dim){
+                out[dim] = m_packing.add(out[dim], block[dim]);
+            }
+        }
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            out[dim] = m_packing.unpack(out[dim]);
+        }
+        return;
+    }
+    std::array<uint32_t, ACC_SIZE> acc;
+    const uint64_t group = std::max<uint64_t>(1, ACC_SIZE / std::max<uint64_t>(1, m_size));
+    for (uint64_t first = 0; first < m_dims; first += group){
+        const uint64_t last = std::min(m_dims, first + group);
+        const uint64_t len = (last - first) * m_size;
+        std::fill(acc.begin(), acc.begin() + len, 0);
+        for (uint64_t col = 0; col < m_size; ++col){
+            const uint32_t digit = digits[col];
+            if (digit == 0) continue;
+            const uint32_t* block = &m_cols[(col * m_dims + first) * m_size];
+            for (uint64_t k = 0; k < len; ++k){
+                acc[k] += digit * block[k];
+            }
+        }
+        for (uint64_t dim = first; dim < last; ++dim){
+            uint64_t result = 0;
+            for (uint64_t row = 0; row < m_size; ++row){
+                result = result * m_base + acc[(dim - first) * m_size + row] % m_base;
+            }
+            out[dim] = shifts ? shiftDigits(result, shifts[dim]) : result;
+        }
+    }
+}
+
+/// Computes the n-th point (double version)
+/// @param n the index of the point
+/// @param out the output coordinates (m_dims values)
+void PointSetSampler::getDoublePoint(uint64_t n, double* out) const {
+    std::vector<uint64_t> ints(m_dims);
+    getIntPoint(n, ints.data());
+    for (uint64_t dim = 0; dim < m_dims; ++dim){
+        out[dim] = toDouble(ints[dim]);
+    }
+}
+
+/// Computes the points of indices \p first .. \p first + \p count - 1 (int version)
+/// @param first the index of the first point
+/// @param count the number of points
+/// @param out the output coordinates, point after point (\p count x m_dims values)
+/// @param shifts if not null, the digit shift of each dimension (m_dims values of m_size digits)
+void PointSetSampler::getIntPoints(uint64_t first, size_t count, uint64_t* out, const uint64_t* shifts) const {
+    if (count == 0)
+        return;
+    //The shift is part of the first point: the carry chains then keep it
+    if (!m_bits.empty()){
+        const uint64_t mask = m_size < 64 ? (uint64_t(1) << m_size) - 1 : ~uint64_t(0);
+        getIntPoint(first, out, shifts);
+        for (size_t i = 1; i < count; ++i){
+            uint64_t* prev = out + (i - 1) * m_dims;
+            uint64_t* point = out + i * m_dims;
+            std::copy(prev, prev + m_dims, point);
+            //Going from n to n+1 flips bits 0..ctz(n+1)
+            const uint64_t low = (first + i) & mask;
+            const uint64_t last = low == 0 ? m_size - 1 : uint64_t(__builtin_ctzll(low));
+            for (uint64_t col = 0; col <= last; ++col){
+                const uint64_t* bits = &m_bits[col * m_dims];
+                for (uint64_t dim = 0; dim < m_dims; ++dim){
+                    point[dim] ^= bits[dim];
+                }
+            }
+        }
+        return;
+    }
+    if (!m_packed.empty()){
+        std::vector<uint64_t> state(m_dims);
+        std::array<uint64_t, 64> digits;
+        getIntPoint(first, state.data(), shifts);
+        uint64_t n = first;
+        for (uint64_t i = 0; i < m_size; ++i){
+            digits[i] = n % m_base;
+            n /= m_base;
+        }
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            state[dim] = m_packing.pack(state[dim]);
+        }
+        for (size_t i = 0; i < count; ++i){
+            if (i > 0){
+                //Carry chain: incrementing or wrapping an index digit adds its column once
+                for (uint64_t col = 0; col < m_size; ++col){
+                    const uint64_t* block = &m_packed[(col * m_base + 1) * m_dims];
+                    for (uint64_t dim = 0; dim < m_dims; ++dim){
+                        state[dim] = m_packing.add(state[dim], block[dim]);
+                    }
+                    if (++digits[col] < m_base) break;
+                    digits[col] = 0;
+                }
+            }
+            uint64_t* point = out + i * m_dims;
+            for (uint64_t dim = 0; dim < m_dims; ++dim){
+                point[dim] = m_packing.unpack(state[dim]);
+            }
+        }
+        return;
+    }
+    //Output digits of every dimension, in the layout of a matrix column block
+    const uint64_t len = m_dims * m_size;
+    const uint32_t base = uint32_t(m_base);
+    std::vector<uint32_t> state(len, 0);
+    std::array<uint32_t, 64> digits;
+    uint64_t n = first;
+    for (uint64_t i = 0; i < m_size; ++i){
+        digits[i] = uint32_t(n % m_base);
+        n /= m_base;
+        const uint32_t* block = &m_cols[i * len];
+        for (uint64_t k = 0; k < len; ++k){
+            state[k] += digits[i] * block[k];
+        }
+    }
+    if (shifts){
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            uint64_t shift = shifts[dim];
+            for (uint64_t row = m_size; row-- > 0;){
+                state[dim * m_size + row] += uint32_t(shift % m_base);
+                shift /= m_base;
+            }
+        }
+    }
+    for (uint64_t k = 0; k < len; ++k){
+        state[k] %= base;
+    }
+    for (size_t i = 0; i < count; ++i){
+        if (i > 0){
+            //Carry chain: incrementing or wrapping an index digit adds its column once
+            for (uint64_t col = 0; col < m_size; ++col){
+                const uint32_t* block = &m_cols[col * len];
+                for (uint64_t k = 0; k < len; ++k){
+                    const uint32_t v = state[k] + block[k];
+                    state[k] = v >= base ? v - base : v;
+                }
+                if (++digits[col] < base) break;
+                digits[col] = 0;
+            }
+        }
+        uint64_t* point = out + i * m_dims;
+        for (uint64_t dim = 0; dim < m_dims; ++dim){
+            uint64_t result = 0;
+            for (uint64_t row = 0; row < m_size; ++row){
+                result = result * m_base + state[dim * m_size + row];
+            }
+            point[dim] = result;
+        }
+    }
+}
+
+/// Computes the points of indices \p first .. \p first + \p count - 1 (double version)
+/// @param first the index of the first point
+/// @param count the number of points
+/// @param out the output coordinates, point after point (\p count x m_dims values)
+void PointSetSampler::getDoublePoints(uint64_t first, size_t count, double* out) const {
+    std::vector<uint64_t> ints(count * m_dims);
+    getIntPoints(first, count, ints.data());
+    const double scale = pow(double(m_base), m_size);
+    for (size_t i = 0; i < ints.size(); ++i){
+        out[i] = double(ints[i]) / scale;
+    }
+}
+
+///Casts a sample int -> double
+/// @param v the int sample
+double PointSetSampler::toDouble(uint64_t v) const {
+    return double(v) / pow(double(m_base), m_size);
+}
+
+/// Returns the digit-wise sum modulo m_base of the m_size digits of \p v and \p shift
+uint64_t PointSetSampler::shiftDigits(uint64_t v, uint64_t shift) const {
+    if (!m_bits.empty())
+        return v ^ shift;
+    if (!m_packed.empty())
+        return m_packing.unpack(m_packing.add(m_packing.pack(v), m_packing.pack(shift)));
+    uint64_t res = 0;
+    uint64_t current = 1;
+    for (uint64_t row = 0; row < m_size; ++row){
+        res += current * ((v % m_base + shift % m_base) % m_base);
+        current *= m_base;
+        v /= m_base;
+        shift /= m_base;
+    }
+    return res;
+}
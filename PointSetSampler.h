@@ -0,0 +1,84 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "PackedDigits.h"
+
+/// Generates whole s-dimensional points from s matrices of the same size and base.
+/// The matrices are stored in one block, column by column: column c of all dimensions is contiguous,
+/// so the digits of an index are extracted once per point and each digit updates every dimension at once.
+class PointSetSampler {
+
+public:
+
+  uint64_t m_size;
+  uint64_t m_base;
+  uint64_t m_dims;
+  //m_cols[(col * m_dims + dim) * m_size + row] = C_dim[row][col]
+  std::vector<uint32_t> m_cols;
+  //base 2 only: m_bits[col * m_dims + dim] is the column col of C_dim (row r in bit m_size-1-r)
+  std::vector<uint64_t> m_bits;
+  //other bases, when m_size digits fit in a word: m_packed[(col * m_base + d) * m_dims + dim] is d times
+  //the column col of C_dim, packed
+  PackedDigits m_packing;
+  std::vector<uint64_t> m_packed;
+
+  PointSetSampler();
+
+  PointSetSampler(const std::vector<std::vector<int>>& mats, const uint64_t size, const uint64_t base);
+
+  void init(const std::vector<std::vector<int>>& mats, const uint64_t size, const uint64_t base);
+
+  /// Returns the number of dimensions
+  uint64_t getDims() const;
+
+  /// Computes the n-th point (int version)
+  /// @param n the index of the point
+  /// @param out the output coordinates (m_dims values)
+  /// @param shifts if not null, the digit shift of each dimension (m_dims values of m_size digits)
+  void getIntPoint(uint64_t n, uint64_t* out, const uint64_t* shifts=nullptr) const;
+
+  /// Computes the n-th point (double version)
+  /// @param n the index of the point
+  /// @param out the output coordinates (m_dims values)
+  void getDoublePoint(uint64_t n, double* out) const;
+
+  /// Computes the points of indices \p first .. \p first + \p count - 1 (int version),
+  /// using incremental generation: one carry chain per point shared by all dimensions
+  /// @param first the index of the first point
+  /// @param count the number of points
+  /// @param out the output coordinates, point after point (\p count x m_dims values)
+  /// @param shifts if not null, the digit shift of each dimension (m_dims values of m_size digits), added to the
+  /// generation state once: shifted points cost the same as unshifted ones
+  void getIntPoints(uint64_t first, size_t count, uint64_t* out, const uint64_t* shifts=nullptr) const;
+
+  /// Computes the points of indices \p first .. \p first + \p count - 1 (double version)
+  /// @param first the index of the first point
+  /// @param count the number of points
+  /// @param out the output coordinates, point after point (\p count x m_dims values)
+  void getDoublePoints(uint64_t first, size_t count, double* out) const;
+
+  ///Casts a sample int -> double
+  /// @param v the int sample
+  double toDouble(uint64_t v) const;
+
+  /// Returns the digit-wise sum modulo m_base of the m_size digits of \p v and \p shift
+  uint64_t shiftDigits(uint64_t v, uint64_t shift) const;
+
+};
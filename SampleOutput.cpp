@@ -0,0 +1,241 @@
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "SampleOutput.h"
+
+//Largest values below 1: samples rounded up to 1 (deep scrambling, base^digits not representable) are clamped to them
+static const float FLOAT_BELOW_ONE = std::nextafter(1.0f, 0.0f);
+static const double DOUBLE_BELOW_ONE = std::nextafter(1.0, 0.0);
+
+/// Stores the \p bytes low bytes of \p v at \p dst, least significant first
+static void storeLE(char* dst, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i){
+        dst[i] = char((v >> (8 * i)) & 0xff);
+    }
+}
+
+/// Appends the \p bytes low bytes of \p v to \p buffer, least significant first
+static void appendLE(std::string& buffer, uint64_t v, int bytes) {
+    char le[8];
+    storeLE(le, v, bytes);
+    buffer.append(le, bytes);
+}
+
+/// Parses a format name (text, bin32, bin64, u64, npy32, npy64 or npyu64)
+/// @param name the format name
+/// @param format the parsed format
+/// @param container the parsed file layout
+/// @returns false if the name is unknown
+bool parseSampleFormat(const std::string& name, SampleFormat& format, SampleContainer& container) {
+    container = name.compare(0, 3, "npy") == 0 ? SampleContainer::Npy : SampleContainer::Raw;
+    if (name == "text") {
+        format = SampleFormat::Text;
+    } else if (name == "bin32" || name == "npy32") {
+        format = SampleFormat::Float32;
+    } else if (name == "bin64" || name == "npy64") {
+        format = SampleFormat::Float64;
+    } else if (name == "u64" || name == "npyu64") {
+        format = SampleFormat::UInt64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Returns the size in bytes of one sample in binary format \p format (0 for text)
+size_t sampleSize(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32: return 4;
+        case SampleFormat::Float64: return 8;
+        case SampleFormat::UInt64: return 8;
+        default: return 0;
+    }
+}
+
+/// Returns the header of binary formats
+/// @param format the binary format
+/// @param s the number of dimensions
+/// @param n the number of points per realization
+/// @param nbReal the number of realizations
+/// @param base the matrices base
+/// @param m the matrices size
+/// @param depth the number of digits of the integer samples
+std::string sampleHeader(SampleFormat format, uint64_t s, uint64_t n, uint64_t nbReal,
+                         uint64_t base, uint64_t m, uint64_t depth) {
+    std::string header("MBSAMPLE");
+    appendLE(header, 1, 4);
+    appendLE(header, uint64_t(format), 4);
+    appendLE(header, s, 8);
+    appendLE(header, n, 8);
+    appendLE(header, nbReal, 8);
+    appendLE(header, base, 4);
+    appendLE(header, m, 4);
+    appendLE(header, depth, 4);
+    header.resize(SAMPLE_HEADER_SIZE, '\0');
+    return header;
+}
+
+/// Returns the header of a NumPy .npy (version 1.0) file of shape (\p nbReal, \p n, \p s)
+/// @param format the binary format
+/// @param nbReal the number of realizations
+/// @param n the number of points per realization
+/// @param s the number of dimensions
+std::string npyHeader(SampleFormat format, uint64_t nbReal, uint64_t n, uint64_t s) {
+    std::string descr;
+    switch (format) {
+        case SampleFormat::Float32: descr = "<f4"; break;
+        case SampleFormat::Float64: descr = "<f8"; break;
+        default: descr = "<u8"; break;
+    }
+    std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + std::to_string(nbReal) + ", "
+                       + std::to_string(n) + ", " + std::to_string(s) + "), }";
+    //magic (6) + version (2) + header length (2) + dict, padded with spaces and ended by '\n'
+    const size_t unpadded = 10 + dict.size() + 1;
+    dict.append((64 - unpadded % 64) % 64, ' ');
+    dict.push_back('\n');
+    std::string header("\x93NUMPY\x01\x00", 8);
+    appendLE(header, dict.size(), 2);
+    return header + dict;
+}
+
+/// Appends \p count integer samples to \p buffer in binary format \p format
+/// @param buffer the output buffer
+/// @param format the binary format
+/// @param ints the integer samples
+/// @param count the number of samples
+/// @param scale the integer samples scale (base^digits)
+void appendSamples(std::string& buffer, SampleFormat format, const uint64_t* ints, size_t count, double scale) {
+    const size_t start = buffer.size();
+    buffer.resize(start + count * sampleSize(format));
+    storeSamples(&buffer[start], format, ints, count, scale);
+}
+
+/// Stores \p count integer samples at \p dst in binary format \p format (count * sampleSize(format) bytes)
+/// @param dst the output memory
+/// @param format the binary format
+/// @param ints the integer samples
+/// @param count the number of samples
+/// @param scale the integer samples scale (base^digits)
+void storeSamples(char* dst, SampleFormat format, const uint64_t* ints, size_t count, double scale) {
+    for (size_t i = 0; i < count; ++i){
+        switch (format) {
+            case SampleFormat::Float32: {
+                const float v = std::min(float(double(ints[i]) / scale), FLOAT_BELOW_ONE);
+                uint32_t bits;
+                memcpy(&bits, &v, sizeof(bits));
+                storeLE(dst + 4 * i, bits, 4);
+                break;
+            }
+            case SampleFormat::Float64: {
+                const double v = std::min(double(ints[i]) / scale, DOUBLE_BELOW_ONE);
+                uint64_t bits;
+                memcpy(&bits, &v, sizeof(bits));
+                storeLE(dst + 8 * i, bits, 8);
+                break;
+            }
+            case SampleFormat::UInt64:
+                storeLE(dst + 8 * i, ints[i], 8);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/// Appends \p count integer samples to \p buffer as text, \p nDims samples per line
+/// @param buffer the output buffer
+/// @param ints the integer samples
+/// @param count the number of samples (multiple of \p nDims)
+/// @param nDims the number of samples per line
+/// @param scale the integer samples scale (base^digits)
+void appendSamplesText(std::string& buffer, const uint64_t* ints, size_t count, size_t nDims, double scale) {
+    //Shortest round-trip representation needs at most 24 characters
+    char number[32];
+    for (size_t i = 0; i < count; ++i){
+        const double v = std::min(double(ints[i]) / scale, DOUBLE_BELOW_ONE);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        const char* end = std::to_chars(number, number + sizeof(number), v).ptr;
+#else
+        const char* end = number + snprintf(number, sizeof(number), "%.17g", v);
+#endif
+        buffer.append(number, size_t(end - number));
+        buffer.push_back(' ');
+        if ((i + 1) % nDims == 0)
+            buffer.push_back('\n');
+    }
+}
+
+MappedOutput::MappedOutput() : m_fd(-1), m_data(nullptr), m_size(0) {}
+
+MappedOutput::~MappedOutput() {
+    close();
+}
+
+/// Creates (or truncates) file \p fname with \p size bytes and maps it
+/// @param fname the file name
+/// @param size the file size in bytes
+/// @returns false if the file could not be created or mapped
+bool MappedOutput::open(const std::string& fname, size_t size) {
+    close();
+    m_fd = ::open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        return false;
+    if (ftruncate(m_fd, off_t(size)) != 0){
+        close();
+        return false;
+    }
+    m_size = size;
+    if (size == 0)
+        return true;
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED){
+        close();
+        return false;
+    }
+    m_data = static_cast<char*>(data);
+    return true;
+}
+
+/// Returns the mapped file content
+char* MappedOutput::data() {
+    return m_data;
+}
+
+/// Writes the content back (msync), unmaps and closes the file
+/// @returns false if the content could not be written back
+bool MappedOutput::close() {
+    bool ok = true;
+    if (m_data != nullptr){
+        //munmap does not report write back errors
+        ok = msync(m_data, m_size, MS_SYNC) == 0;
+        ok = munmap(m_data, m_size) == 0 && ok;
+        m_data = nullptr;
+    }
+    if (m_fd >= 0){
+        ok = ::close(m_fd) == 0 && ok;
+        m_fd = -1;
+    }
+    m_size = 0;
+    return ok;
+}
@@ -0,0 +1,127 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+/// Output formats of the sampler
+/// Text: one point per line, realizations separated by '#' lines
+/// Float32, Float64, UInt64: binary header (see writeSampleHeader) followed by the raw little-endian
+/// samples, realization after realization, point after point
+enum class SampleFormat { Text, Float32, Float64, UInt64 };
+
+/// File layouts of binary formats
+/// Raw: header of sampleHeader followed by the samples
+/// Npy: NumPy .npy file (header of npyHeader) of shape (nbReal, N, s), loadable with np.load(mmap_mode='r')
+enum class SampleContainer { Raw, Npy };
+
+/// Parses a format name (text, bin32, bin64, u64, npy32, npy64 or npyu64)
+/// @param name the format name
+/// @param format the parsed format
+/// @param container the parsed file layout
+/// @returns false if the name is unknown
+bool parseSampleFormat(const std::string& name, SampleFormat& format, SampleContainer& container);
+
+/// Returns the size in bytes of one sample in binary format \p format (0 for text)
+size_t sampleSize(SampleFormat format);
+
+/// Size in bytes of the binary header
+const size_t SAMPLE_HEADER_SIZE = 64;
+
+/// Returns the header of binary formats: 64 bytes, little-endian
+///   char[8] magic "MBSAMPLE", uint32 version (1), uint32 format (1: float32, 2: float64, 3: uint64),
+///   uint64 s, uint64 N, uint64 nbReal, uint32 base, uint32 m, uint32 depth (integer samples have depth digits),
+///   zero padding up to 64 bytes
+/// @param format the binary format
+/// @param s the number of dimensions
+/// @param n the number of points per realization
+/// @param nbReal the number of realizations
+/// @param base the matrices base
+/// @param m the matrices size
+/// @param depth the number of digits of the integer samples
+std::string sampleHeader(SampleFormat format, uint64_t s, uint64_t n, uint64_t nbReal,
+                         uint64_t base, uint64_t m, uint64_t depth);
+
+/// Returns the header of a NumPy .npy (version 1.0) file of shape (\p nbReal, \p n, \p s), C order,
+/// with data type '<f4', '<f8' or '<u8' according to \p format. The header size is a multiple of 64 bytes.
+/// @param format the binary format
+/// @param nbReal the number of realizations
+/// @param n the number of points per realization
+/// @param s the number of dimensions
+std::string npyHeader(SampleFormat format, uint64_t nbReal, uint64_t n, uint64_t s);
+
+/// Appends \p count integer samples to \p buffer in binary format \p format
+/// Floating point samples are \p ints[i] / \p scale
+/// @param buffer the output buffer
+/// @param format the binary format
+/// @param ints the integer samples
+/// @param count the number of samples
+/// @param scale the integer samples scale (base^digits)
+void appendSamples(std::string& buffer, SampleFormat format, const uint64_t* ints, size_t count, double scale);
+
+/// Stores \p count integer samples at \p dst in binary format \p format (count * sampleSize(format) bytes)
+/// @param dst the output memory
+/// @param format the binary format
+/// @param ints the integer samples
+/// @param count the number of samples
+/// @param scale the integer samples scale (base^digits)
+void storeSamples(char* dst, SampleFormat format, const uint64_t* ints, size_t count, double scale);
+
+/// Appends \p count integer samples to \p buffer as text, \p nDims samples per line
+/// Samples are \p ints[i] / \p scale written with the shortest representation that reads back to the same double
+/// @param buffer the output buffer
+/// @param ints the integer samples
+/// @param count the number of samples (multiple of \p nDims)
+/// @param nDims the number of samples per line
+/// @param scale the integer samples scale (base^digits)
+void appendSamplesText(std::string& buffer, const uint64_t* ints, size_t count, size_t nDims, double scale);
+
+/// Output file preallocated to its final size and mapped in memory, so that fixed size outputs
+/// can be written in place by several threads (POSIX mmap)
+class MappedOutput {
+
+public:
+
+  MappedOutput();
+
+  ~MappedOutput();
+
+  MappedOutput(const MappedOutput&) = delete;
+
+  MappedOutput& operator=(const MappedOutput&) = delete;
+
+  /// Creates (or truncates) file \p fname with \p size bytes and maps it
+  /// @param fname the file name
+  /// @param size the file size in bytes
+  /// @returns false if the file could not be created or mapped
+  bool open(const std::string& fname, size_t size);
+
+  /// Returns the mapped file content
+  char* data();
+
+  /// Writes the content back (msync), unmaps and closes the file
+  /// @returns false if the content could not be written back
+  bool close();
+
+private:
+
+  int m_fd;
+  char* m_data;
+  size_t m_size;
+
+};
@@ -13,8 +13,18 @@ Copyright 2022, CNRS
    See the License for the specific language governing permissions and
    limitations under the License.
 */
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <random>
 #include "Scrambling.h"
+#include "TargetClones.h"
+
+//Number of values scrambled together by owenScrambleBatch
+static const size_t BATCH_BLOCK = 256;
+//Maximum number of entries of the ScrambleContext tables (when the number of levels is not given)
+static const uint64_t CONTEXT_TABLE_SIZE = 1024;
 
 static uint32_t hash3( uint32_t x ) {
     // finalizer from murmurhash3
@@ -26,14 +36,12 @@ static uint32_t hash3( uint32_t x ) {
     return x;
 }
 
-/// Scramble an index
-/// @param i the index to scramble
-/// @param seed a seed
-/// @param m the matrix size
-/// @param base the base
-/// @returns a new index
-uint64_t scramble(uint64_t i, int seed, int m, int base)
+/// Random digit shift of the \p m digits of \p i in base \p Base
+/// (0 for a runtime base given by \p runtimeBase)
+template<int Base>
+static uint64_t scrambleKernel(uint64_t i, int seed, int m, int runtimeBase)
 {
+    const int base = Base ? Base : runtimeBase;
     std::minstd_rand gen(seed);
     std::uniform_int_distribution<int> unif(0,base-1);
     uint64_t res = 0;
@@ -46,31 +54,501 @@ uint64_t scramble(uint64_t i, int seed, int m, int base)
     return res;
 }
 
-
-/// Owen Scramble an index
-/// @param i the index to scramble
-/// @param seed a seed
-/// @param m the matrix size
-/// @param base the base
-/// @returns a new index
-uint64_t owenScramble(uint64_t i, int seed, int m, int base){
+/// Owen scrambling of the \p m digits of \p i in base \p Base
+/// (0 for a runtime base given by \p runtimeBase)
+template<int Base>
+static uint64_t owenScrambleKernel(uint64_t i, int seed, int m, int runtimeBase){
+    const int base = Base ? Base : runtimeBase;
+    assert(m <= 64);
     std::minstd_rand gen(hash3(seed));
     std::uniform_int_distribution<int> unif(0,base-1);
     std::uniform_int_distribution<int> nextSeed;
+    //Digits of i, weak digits first
+    std::array<int, 64> digits;
+    for (int pos = 0; pos < m; ++pos){
+        digits[pos] = int(i % base);
+        i /= base;
+    }
     uint64_t res = 0;
     //We start from strong digits
-    uint64_t current = uint64_t(round(pow(base, m-1)));
-
-    for (int pos = 0; pos < m; ++pos){
+    for (int pos = m-1; pos >= 0; --pos){
         int permut = unif(gen);
-        int digit = (i / current) % base;
+        int digit = digits[pos];
         //Apply permutation
-        res += uint64_t((digit + permut) % base) * current;
+        res = res * base + uint64_t((digit + permut) % base);
         //Move to next node in Owen tree
         gen.seed(hash3(nextSeed(gen) + digit));
-        //Move to next digit
-        i -= digit * current;
-        current /= uint64_t(base);
     }
     return res;
 }
+
+/// Root node of the hashed Owen tree of seed \p seed
+static inline uint32_t rootNode(int seed){
+    return hash3(uint32_t(seed) + 0x9e3779b9u);
+}
+
+/// Child of node \p node along digit \p digit in the hashed Owen tree
+static inline uint32_t childNode(uint32_t node, uint32_t digit){
+    return hash3(node ^ ((digit + 1) * 0x9e3779b9u));
+}
+
+/// Random digit shift in [0, base) of node \p node in the hashed Owen tree
+static inline uint32_t nodeShift(uint32_t node, uint32_t base){
+    return uint32_t((uint64_t(node) * base) >> 32);
+}
+
+/// Reverses the bits of \p x
+static inline uint32_t reverseBits(uint32_t x){
+    x = __builtin_bswap32(x);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x >> 4) & 0x0f0f0f0fu);
+    x = ((x & 0x33333333u) << 2) | ((x >> 2) & 0x33333333u);
+    x = ((x & 0x55555555u) << 1) | ((x >> 1) & 0x55555555u);
+    return x;
+}
+
+/// Reverses the bits of \p x
+static inline uint64_t reverseBits(uint64_t x){
+    x = __builtin_bswap64(x);
+    x = ((x & 0x0f0f0f0f0f0f0f0full) << 4) | ((x >> 4) & 0x0f0f0f0f0f0f0f0full);
+    x = ((x & 0x3333333333333333ull) << 2) | ((x >> 2) & 0x3333333333333333ull);
+    x = ((x & 0x5555555555555555ull) << 1) | ((x >> 1) & 0x5555555555555555ull);
+    return x;
+}
+
+/// Laine-Karras style permutation: every operation only propagates bits upwards, so bit k of the result
+/// only depends on bits 0..k of \p x (Burley 2020 constants)
+static inline uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed){
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return x;
+}
+
+/// 64 bits version of the Laine-Karras style permutation (even constants for the xor-multiply steps)
+static inline uint64_t laineKarrasPermutation(uint64_t x, uint64_t seed){
+    x ^= x * 0x3d20adea5e8c2e26ull;
+    x += seed;
+    x *= (seed >> 32) | 1u;
+    x ^= x * 0x05526c56a6a9e1b4ull;
+    x ^= x * 0x53a22864d1b54a32ull;
+    return x;
+}
+
+/// Base 2 Owen Scramble (nested uniform scramble) of the \p depth bits of \p x
+/// @param x the value to scramble (\p depth bits)
+/// @param seed a seed
+/// @param depth the number of bits (<= 64)
+/// @returns the scrambled value (\p depth bits)
+uint64_t owenScrambleBase2(uint64_t x, int seed, int depth){
+    assert(depth <= 64);
+    if (depth <= 0)
+        return 0;
+    //Strong digits are moved to the low bits, where they influence all the weaker ones
+    const uint32_t hashed = hash3(uint32_t(seed) + 0x9e3779b9u);
+    if (depth <= 32){
+        const uint32_t y = reverseBits(uint32_t(x) << (32 - depth));
+        return reverseBits(laineKarrasPermutation(y, hashed)) >> (32 - depth);
+    }
+    const uint64_t seed64 = (uint64_t(hashed) << 32) | hash3(hashed ^ 0x85ebca6bu);
+    const uint64_t y = reverseBits(x << (64 - depth));
+    return reverseBits(laineKarrasPermutation(y, seed64)) >> (64 - depth);
+}
+
+/// Hash based Owen scrambling of the \p m digits of \p i in base \p Base
+/// (0 for a runtime base given by \p runtimeBase), from node \p node of the tree
+/// @param res the scrambled digits leading to \p node (0 from the root)
+template<int Base>
+static uint64_t owenScrambleHashKernel(uint64_t i, uint32_t node, uint64_t res, int m, int runtimeBase){
+    const uint32_t base = Base ? Base : runtimeBase;
+    assert(m <= 64);
+    //Digits of i, weak digits first
+    std::array<uint32_t, 64> digits;
+    for (int pos = 0; pos < m; ++pos){
+        digits[pos] = uint32_t(i % base);
+        i /= base;
+    }
+    //We start from strong digits
+    for (int pos = m-1; pos >= 0; --pos){
+        const uint32_t digit = digits[pos];
+        const uint32_t shifted = digit + nodeShift(node, base);
+        res = res * base + (shifted >= base ? shifted - base : shifted);
+        node = childNode(node, digit);
+    }
+    return res;
+}
+
+/// Owen scrambling of the \p count (<= BATCH_BLOCK) values of \p in with \p context, in base \p Base
+/// (0 for the runtime base of the context), see owenScrambleBatch
+template<int Base>
+MATBUILDER_TARGET_CLONES
+static void owenScrambleBlock(const uint64_t* in, uint64_t* out, size_t count, const ScrambleContext& context){
+    const uint32_t base = Base ? Base : uint32_t(context.m_base);
+    const int depth = context.m_depth;
+    assert(depth <= 64 && count <= BATCH_BLOCK);
+    //Values are split in 32 bits limbs of limbDigits digits, whose digits are extracted for all the values at once
+    int limbDigits = 0;
+    uint64_t limbBase = 1;
+    while (limbBase * base <= (uint64_t(1) << 32)){
+        limbBase *= base;
+        ++limbDigits;
+    }
+    //digits[pos][k]: digit pos of value k, weak digits first
+    uint8_t digits[64][BATCH_BLOCK];
+    uint64_t rest[BATCH_BLOCK];
+    uint32_t limbs[BATCH_BLOCK];
+    std::copy(in, in + count, rest);
+    for (int low = 0; low < depth; low += limbDigits){
+        for (size_t k = 0; k < count; ++k){
+            limbs[k] = uint32_t(rest[k] % limbBase);
+            rest[k] /= limbBase;
+        }
+        for (int pos = low; pos < std::min(depth, low + limbDigits); ++pos){
+            for (size_t k = 0; k < count; ++k){
+                digits[pos][k] = uint8_t(limbs[k] % base);
+                limbs[k] /= base;
+            }
+        }
+    }
+    //The top m_levels digits index the precomputed nodes
+    uint32_t nodes[BATCH_BLOCK];
+    uint64_t res[BATCH_BLOCK];
+    uint32_t prefixes[BATCH_BLOCK] = {};
+    for (int pos = depth-1; pos >= depth - context.m_levels; --pos){
+        const uint8_t* level = digits[pos];
+        for (size_t k = 0; k < count; ++k){
+            prefixes[k] = prefixes[k] * base + level[k];
+        }
+    }
+    for (size_t k = 0; k < count; ++k){
+        nodes[k] = context.m_nodes[prefixes[k]];
+        res[k] = context.m_prefixes[prefixes[k]];
+    }
+    //We continue from strong digits, one tree level for all the values
+    for (int pos = depth - context.m_levels - 1; pos >= 0; --pos){
+        const uint8_t* level = digits[pos];
+        for (size_t k = 0; k < count; ++k){
+            const uint32_t digit = level[k];
+            const uint32_t shifted = digit + nodeShift(nodes[k], base);
+            res[k] = res[k] * base + (shifted >= base ? shifted - base : shifted);
+            nodes[k] = childNode(nodes[k], digit);
+        }
+    }
+    std::copy(res, res + count, out);
+}
+
+/// Base 2 Owen scrambling of \p count values, see owenScrambleBatch
+MATBUILDER_TARGET_CLONES
+static void owenScrambleBase2Block(const uint64_t* in, uint64_t* out, size_t count, int seed, int depth){
+    for (size_t k = 0; k < count; ++k){
+        out[k] = owenScrambleBase2(in[k], seed, depth);
+    }
+}
+
+/// Precomputes the scrambling of \p seed
+/// @param seed a seed
+/// @param depth the number of digits of the scrambled values
+/// @param base the base
+/// @param levels the number of levels to precompute (negative: as many as fit in a small table)
+ScrambleContext::ScrambleContext(int seed, int depth, int base, int levels)
+    : m_seed(seed), m_depth(depth), m_base(base) {
+    if (base == 2){
+        levels = 0;
+    } else if (levels < 0){
+        levels = 0;
+        for (uint64_t size = base; levels < depth && size <= CONTEXT_TABLE_SIZE; size *= base) ++levels;
+    }
+    m_levels = std::min(levels, depth);
+    for (int pos = m_levels; pos < depth; ++pos){
+        m_lowSize *= uint64_t(base);
+    }
+    //Level after level, the children of entry p are the entries p * base + digit
+    m_prefixes.assign(1, 0);
+    m_nodes.assign(1, rootNode(seed));
+    for (int level = 0; level < m_levels; ++level){
+        std::vector<uint64_t> prefixes(m_prefixes.size() * base);
+        std::vector<uint32_t> nodes(m_nodes.size() * base);
+        for (size_t p = 0; p < m_nodes.size(); ++p){
+            const uint32_t shift = nodeShift(m_nodes[p], uint32_t(base));
+            for (int digit = 0; digit < base; ++digit){
+                prefixes[p * base + digit] = m_prefixes[p] * base + (uint32_t(digit) + shift) % uint32_t(base);
+                nodes[p * base + digit] = childNode(m_nodes[p], uint32_t(digit));
+            }
+        }
+        m_prefixes.swap(prefixes);
+        m_nodes.swap(nodes);
+    }
+}
+
+/// Owen Scrambles \p i: returns owenScramble(i, seed, depth, base)
+/// @param i the value to scramble (depth digits)
+uint64_t ScrambleContext::scramble(uint64_t i) const {
+    if (m_base == 2)
+        return owenScrambleBase2(i, m_seed, m_depth);
+    uint64_t prefix = 0;
+    if (m_levels > 0){
+        prefix = i / m_lowSize;
+        i -= prefix * m_lowSize;
+        if (prefix >= m_nodes.size()) prefix %= m_nodes.size();
+    }
+    const int depth = m_depth - m_levels;
+    switch (m_base) {
+        case 3: return owenScrambleHashKernel<3>(i, m_nodes[prefix], m_prefixes[prefix], depth, m_base);
+        case 5: return owenScrambleHashKernel<5>(i, m_nodes[prefix], m_prefixes[prefix], depth, m_base);
+        case 7: return owenScrambleHashKernel<7>(i, m_nodes[prefix], m_prefixes[prefix], depth, m_base);
+        default: return owenScrambleHashKernel<0>(i, m_nodes[prefix], m_prefixes[prefix], depth, m_base);
+    }
+}
+
+/// Owen Scrambles \p n values (see owenScrambleBatch)
+/// @param in the values to scramble (depth digits)
+/// @param out the scrambled values
+/// @param n the number of values
+void ScrambleContext::scrambleBatch(const uint64_t* in, uint64_t* out, size_t n) const {
+    if (m_base == 2){
+        owenScrambleBase2Block(in, out, n, m_seed, m_depth);
+        return;
+    }
+    if (m_base > 256){
+        //Digits do not fit the byte planes of owenScrambleBlock
+        for (size_t k = 0; k < n; ++k){
+            out[k] = scramble(in[k]);
+        }
+        return;
+    }
+    for (size_t first = 0; first < n; first += BATCH_BLOCK){
+        const size_t count = std::min(BATCH_BLOCK, n - first);
+        switch (m_base) {
+            case 3: owenScrambleBlock<3>(in + first, out + first, count, *this); break;
+            case 5: owenScrambleBlock<5>(in + first, out + first, count, *this); break;
+            case 7: owenScrambleBlock<7>(in + first, out + first, count, *this); break;
+            default: owenScrambleBlock<0>(in + first, out + first, count, *this); break;
+        }
+    }
+}
+
+/// Owen Scramble \p n values with the same seed: out[k] = owenScramble(in[k], seed, depth, base)
+/// @param in the values to scramble (\p depth digits)
+/// @param out the scrambled values
+/// @param n the number of values
+/// @param seed a seed
+/// @param depth the number of digits
+/// @param base the base
+void owenScrambleBatch(const uint64_t* in, uint64_t* out, size_t n, int seed, int depth, int base){
+    ScrambleContext(seed, depth, base, 0).scrambleBatch(in, out, n);
+}
+
+/// Scramble an index with a random digit shift
+/// @param i the index to scramble
+/// @param seed a seed
+/// @param m the matrix size
+/// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based digit shift
+/// @returns a new index
+uint64_t scramble(uint64_t i, int seed, int m, int base, bool legacy)
+{
+    if (!legacy)
+        return digitShift(i, randomDigitShift(seed, m, base), m, base);
+    switch (base) {
+        case 2: return scrambleKernel<2>(i, seed, m, base);
+        case 3: return scrambleKernel<3>(i, seed, m, base);
+        case 5: return scrambleKernel<5>(i, seed, m, base);
+        case 7: return scrambleKernel<7>(i, seed, m, base);
+        default: return scrambleKernel<0>(i, seed, m, base);
+    }
+}
+
+/// Returns the seed of realization \p real of a randomized point set of master seed \p seed
+/// @param seed the master seed
+/// @param real the index of the realization
+int realizationSeed(int seed, int real){
+    const uint32_t hashed = hash3(hash3(uint32_t(seed) + 0x9e3779b9u) ^ (uint32_t(real) * 0x85ebca6bu + 0xc2b2ae35u));
+    //Non negative, as the seeds drawn by std::uniform_int_distribution<int>
+    return int(hashed >> 1);
+}
+
+/// Returns the random digit shift of \p seed
+/// @param seed a seed
+/// @param depth the number of digits
+/// @param base the base
+uint64_t randomDigitShift(int seed, int depth, int base){
+    uint32_t node = hash3(uint32_t(seed) ^ 0x68e31da4u);
+    uint64_t res = 0;
+    for (int pos = 0; pos < depth; ++pos){
+        node = hash3(node + 0x9e3779b9u);
+        res = res * base + nodeShift(node, uint32_t(base));
+    }
+    return res;
+}
+
+/// Digit-wise sum modulo \p base of the \p depth digits of \p x and \p shift
+/// @param x the value to shift
+/// @param shift the shift
+/// @param depth the number of digits
+/// @param base the base
+uint64_t digitShift(uint64_t x, uint64_t shift, int depth, int base){
+    if (base == 2)
+        return depth < 64 ? (x ^ shift) & ((uint64_t(1) << depth) - 1) : x ^ shift;
+    uint64_t res = 0;
+    uint64_t current = 1;
+    for (int pos = 0; pos < depth; ++pos){
+        res += current * ((x % base + shift % base) % base);
+        current *= base;
+        x /= base;
+        shift /= base;
+    }
+    return res;
+}
+
+/// Matousek's linear matrix scrambling: \p out = L . \p C in GF(\p base)
+/// @param C the matrix to scramble (\p m x \p m, row after row)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param base the base (prime)
+/// @param out the scrambled matrix
+void linearScrambleMatrix(const std::vector<int>& C, int seed, int m, int base, std::vector<int>& out){
+    //L[row][col], col <= row, drawn from a hash chain
+    std::vector<int> L(m * m, 0);
+    uint32_t node = hash3(uint32_t(seed) ^ 0xb5297a4du);
+    for (int row = 0; row < m; ++row){
+        for (int col = 0; col <= row; ++col){
+            node = hash3(node + 0x9e3779b9u);
+            L[row * m + col] = col == row ? 1 + int(nodeShift(node, uint32_t(base - 1))) : int(nodeShift(node, uint32_t(base)));
+        }
+    }
+    out.assign(m * m, 0);
+    for (int row = 0; row < m; ++row){
+        for (int col = 0; col < m; ++col){
+            int64_t sum = 0;
+            for (int k = 0; k <= row; ++k){
+                sum += int64_t(L[row * m + k]) * C[k * m + col];
+            }
+            out[row * m + col] = int(sum % base);
+        }
+    }
+}
+
+/// Owen Scramble an index
+/// @param i the index to scramble
+/// @param seed a seed
+/// @param m the matrix size
+/// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based scrambling (slower)
+/// @returns a new index
+uint64_t owenScramble(uint64_t i, int seed, int m, int base, bool legacy){
+    if (!legacy){
+        switch (base) {
+            case 2: return owenScrambleBase2(i, seed, m);
+            case 3: return owenScrambleHashKernel<3>(i, rootNode(seed), 0, m, base);
+            case 5: return owenScrambleHashKernel<5>(i, rootNode(seed), 0, m, base);
+            case 7: return owenScrambleHashKernel<7>(i, rootNode(seed), 0, m, base);
+            default: return owenScrambleHashKernel<0>(i, rootNode(seed), 0, m, base);
+        }
+    }
+    switch (base) {
+        case 2: return owenScrambleKernel<2>(i, seed, m, base);
+        case 3: return owenScrambleKernel<3>(i, seed, m, base);
+        case 5: return owenScrambleKernel<5>(i, seed, m, base);
+        case 7: return owenScrambleKernel<7>(i, seed, m, base);
+        default: return owenScrambleKernel<0>(i, seed, m, base);
+    }
+}
+
+/// Owen Scramble a sample of a \p m x \p m matrix, extended with zero digits up to \p depth digits
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m)
+/// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based scrambling (slower)
+/// @returns the scrambled sample (depth digits)
+uint64_t owenScrambleSample(uint64_t sample, int seed, int m, int depth, int base, bool legacy){
+    assert(depth <= maxScrambleDepth(base));
+    uint64_t i = sample;
+    for (int pos = m; pos < depth; ++pos){
+        i *= uint64_t(base);
+    }
+    return owenScramble(i, seed, depth, base, legacy);
+}
+
+/// Returns the largest depth whose scrambled integers fit 64 bits
+/// @param base the base
+int maxScrambleDepth(int base){
+    //floor(2^64 / base), from 2^64 - 1 = q * base + r
+    const uint64_t limit = ~uint64_t(0) / uint64_t(base) + (~uint64_t(0) % uint64_t(base) == uint64_t(base) - 1);
+    int depth = 0;
+    //value = base^depth, base^(depth + 1) <= 2^64 iff value <= floor(2^64 / base)
+    for (uint64_t value = 1; value <= limit; value *= uint64_t(base)){
+        ++depth;
+        if (value > ~uint64_t(0) / uint64_t(base)) break;
+    }
+    return depth;
+}
+
+/// Returns the number of digits in base \p base that saturate a \p bits bits mantissa
+/// @param base the base
+/// @param bits the mantissa precision (53 for double, 24 for float)
+int precisionDigits(int base, int bits){
+    assert(bits < 64);
+    const uint64_t target = uint64_t(1) << bits;
+    int digits = 0;
+    for (uint64_t value = 1; value < target; ++digits){
+        if (value > target / base){
+            ++digits;
+            break;
+        }
+        value *= base;
+    }
+    return digits;
+}
+
+int scrambledDigits(int base, int depth, int bits){
+    if (base == 2 && depth > 32)
+        return std::min(depth, 64);
+    return std::min(depth, precisionDigits(base, bits));
+}
+
+/// Owen Scrambles the first \p digits digits of a sample of a \p m x \p m matrix extended with zero digits,
+/// returns them as an integer in [0, base^digits) and base^digits in \p scale
+static uint64_t scrambleStrongDigits(uint64_t sample, int seed, int m, int digits, int base, double& scale){
+    //base^digits may be 2^64
+    scale = 1;
+    for (int pos = 0; pos < digits; ++pos){
+        scale *= base;
+    }
+    for (int pos = m; pos < digits; ++pos){
+        sample *= uint64_t(base);
+    }
+    for (int pos = digits; pos < m; ++pos){
+        sample /= uint64_t(base);
+    }
+    return owenScramble(sample, seed, digits, base);
+}
+
+/// Owen Scramble a sample of a \p m x \p m matrix at any depth, as a double in [0, 1)
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m)
+/// @param base the base
+/// @returns the scrambled sample
+double owenScrambleSampleDouble(uint64_t sample, int seed, int m, int depth, int base){
+    double scale;
+    const uint64_t digits = scrambleStrongDigits(sample, seed, m, scrambledDigits(base, depth, 53), base, scale);
+    //Rounding may reach 1 when base^digits is not representable
+    return std::min(double(digits) / scale, std::nextafter(1.0, 0.0));
+}
+
+/// Owen Scramble a sample of a \p m x \p m matrix at any depth, as a float in [0, 1)
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m)
+/// @param base the base
+/// @returns the scrambled sample
+float owenScrambleSampleFloat(uint64_t sample, int seed, int m, int depth, int base){
+    double scale;
+    const uint64_t digits = scrambleStrongDigits(sample, seed, m, scrambledDigits(base, depth, 24), base, scale);
+    return std::min(float(double(digits) / scale), std::nextafter(1.0f, 0.0f));
+}
@@ -15,23 +15,170 @@ Copyright 2022, CNRS
    limitations under the License.
 */
 
+#include <cstddef>
+#include <cstdint>
 #include <random>
+#include <vector>
 
 static
 uint32_t hash3( uint32_t x );
 
-/// Scramble an index
+/// Scramble an index with a random digit shift: scramble(i) = digitShift(i, randomDigitShift(seed, m, base), m, base)
 /// @param i the index to scramble
 /// @param seed a seed
 /// @param m the matrix size
 /// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based digit shift
 /// @returns a new index
-uint64_t scramble(uint64_t i, int seed, int m, int base);
+uint64_t scramble(uint64_t i, int seed, int m, int base, bool legacy=false);
 
-/// Owen Scramble an index
+/// Returns the seed of realization \p real of a randomized point set of master seed \p seed: a hash of both,
+/// so that realizations can be generated independently, in any order
+/// @param seed the master seed
+/// @param real the index of the realization
+int realizationSeed(int seed, int real);
+
+/// Returns the random digit shift of \p seed: \p depth digits drawn from a hash chain
+/// @param seed a seed
+/// @param depth the number of digits
+/// @param base the base
+uint64_t randomDigitShift(int seed, int depth, int base);
+
+/// Digit-wise sum modulo \p base of the \p depth digits of \p x and \p shift (xor in base 2)
+/// @param x the value to shift
+/// @param shift the shift
+/// @param depth the number of digits
+/// @param base the base
+uint64_t digitShift(uint64_t x, uint64_t shift, int depth, int base);
+
+/// Matousek's linear matrix scrambling: \p out = L . \p C in GF(\p base), with L a random lower triangular
+/// matrix with a non zero diagonal. Output digit r of the samples becomes a random linear combination of
+/// digits 0..r (strong digits first), which preserves the (t,m,s) properties of the matrices.
+/// @param C the matrix to scramble (\p m x \p m, row after row)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param base the base (prime)
+/// @param out the scrambled matrix
+void linearScrambleMatrix(const std::vector<int>& C, int seed, int m, int base, std::vector<int>& out);
+
+/// Owen Scramble an index.
+/// The random digit shift of each node of the Owen tree is derived from a hash of its parent node and of the
+/// digit leading to it (no random number generator, no floating point). Base 2 uses owenScrambleBase2.
 /// @param i the index to scramble
 /// @param seed a seed
 /// @param m the matrix size
 /// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based scrambling (slower)
 /// @returns a new index
-uint64_t owenScramble(uint64_t i, int seed, int m, int base);
+uint64_t owenScramble(uint64_t i, int seed, int m, int base, bool legacy=false);
+
+/// Base 2 Owen Scramble (nested uniform scramble) of the \p depth bits of \p x, computed at once with a
+/// Laine-Karras style hash on the reversed bits (Burley 2020): 32 bits hash when \p depth <= 32, 64 bits hash otherwise
+/// @param x the value to scramble (\p depth bits)
+/// @param seed a seed
+/// @param depth the number of bits (<= 64)
+/// @returns the scrambled value (\p depth bits)
+uint64_t owenScrambleBase2(uint64_t x, int seed, int depth);
+
+/// Owen Scramble \p n values with the same seed: out[k] = owenScramble(in[k], seed, depth, base).
+/// Values are processed by blocks, tree level after tree level, so that the node hashes of a level are
+/// computed for all the values of a block at once (SIMD lanes). \p in and \p out may be the same array.
+/// @param in the values to scramble (\p depth digits)
+/// @param out the scrambled values
+/// @param n the number of values
+/// @param seed a seed
+/// @param depth the number of digits
+/// @param base the base
+void owenScrambleBatch(const uint64_t* in, uint64_t* out, size_t n, int seed, int depth, int base);
+
+/// Owen scrambling of a given seed and depth (same results as owenScramble) with the first levels of the tree
+/// precomputed: the top m_levels digits of a value index a table holding their scrambled digits and the node
+/// they lead to, so that only the nodes below are hashed. Built once per seed (e.g. per dimension and
+/// realization) and shared by all the values scrambled with it. Base 2 uses owenScrambleBase2 (no table).
+class ScrambleContext {
+
+public:
+
+  int m_seed = 0;
+  int m_depth = 0;
+  int m_base = 2;
+  //number of precomputed levels
+  int m_levels = 0;
+  //m_base^(m_depth - m_levels): number of values below a node of level m_levels
+  uint64_t m_lowSize = 1;
+  //m_prefixes[p]: scrambled value of the top m_levels digits p of a value
+  std::vector<uint64_t> m_prefixes;
+  //m_nodes[p]: hash of the node reached by the top m_levels digits p of a value
+  std::vector<uint32_t> m_nodes;
+
+  ScrambleContext() {}
+
+  /// Precomputes the scrambling of \p seed
+  /// @param seed a seed
+  /// @param depth the number of digits of the scrambled values
+  /// @param base the base
+  /// @param levels the number of levels to precompute (negative: as many as fit in a small table)
+  ScrambleContext(int seed, int depth, int base, int levels=-1);
+
+  /// Owen Scrambles \p i: returns owenScramble(i, seed, depth, base)
+  /// @param i the value to scramble (depth digits)
+  uint64_t scramble(uint64_t i) const;
+
+  /// Owen Scrambles \p n values (see owenScrambleBatch). \p in and \p out may be the same array.
+  /// @param in the values to scramble (depth digits)
+  /// @param out the scrambled values
+  /// @param n the number of values
+  void scrambleBatch(const uint64_t* in, uint64_t* out, size_t n) const;
+
+};
+
+/// Owen Scramble a sample of a \p m x \p m matrix, extended with zero digits up to \p depth digits
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m, <= maxScrambleDepth(base))
+/// @param base the base
+/// @param legacy reproduces the original std::minstd_rand based scrambling (slower)
+/// @returns the scrambled sample (depth digits)
+uint64_t owenScrambleSample(uint64_t sample, int seed, int m, int depth, int base, bool legacy=false);
+
+/// Returns the largest depth whose scrambled integers fit 64 bits: the largest d with base^d <= 2^64
+/// (e.g. 64 in base 2, 40 in base 3)
+/// @param base the base
+int maxScrambleDepth(int base);
+
+/// Returns the number of digits in base \p base that saturate a \p bits bits mantissa: the smallest L with
+/// base^L >= 2^bits. Weaker digits of a value in [0, 1) are not representable.
+/// @param base the base
+/// @param bits the mantissa precision (53 for double, 24 for float)
+int precisionDigits(int base, int bits);
+
+/// Returns the number of digits to scramble for a value in [0, 1) with a \p bits bits mantissa at depth \p depth:
+/// min(depth, precisionDigits(base, bits)), except in base 2 above 32 digits where owenScrambleBase2 uses a 64 bits
+/// permutation whose strong digits differ from the 32 bits one: min(depth, 64) digits are scrambled then.
+/// @param base the base
+/// @param depth the scrambling depth
+/// @param bits the mantissa precision (53 for double, 24 for float)
+int scrambledDigits(int base, int depth, int bits);
+
+/// Owen Scramble a sample of a \p m x \p m matrix at any depth, as a double in [0, 1).
+/// Only the scrambledDigits(base, depth, 53) strong digits are scrambled: they are the strong digits of
+/// owenScrambleSample (the tree is walked from strong digits), without its 64 bits overflow for deep scrambling
+/// and without the tree levels that the mantissa cannot hold.
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m)
+/// @param base the base
+/// @returns the scrambled sample
+double owenScrambleSampleDouble(uint64_t sample, int seed, int m, int depth, int base);
+
+/// Owen Scramble a sample of a \p m x \p m matrix at any depth, as a float in [0, 1)
+/// (scrambledDigits(base, depth, 24) digits, see owenScrambleSampleDouble)
+/// @param sample the sample to scramble (m digits)
+/// @param seed a seed
+/// @param m the matrix size
+/// @param depth the scrambling depth (>= m)
+/// @param base the base
+/// @returns the scrambled sample
+float owenScrambleSampleFloat(uint64_t sample, int seed, int m, int depth, int base);
@@ -0,0 +1,24 @@
+#pragma once
+/*
+Copyright 2022, CNRS
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+//Batch loops are compiled for several instruction sets, the best one is picked
+//when the program is loaded from the CPU features (plain loop elsewhere)
+#if defined(__x86_64__) && defined(__linux__) && (!defined(__clang__) || __clang_major__ >= 14)
+#define MATBUILDER_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MATBUILDER_TARGET_CLONES
+#endif
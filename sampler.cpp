@@ -15,13 +15,21 @@ Copyright 2022, CNRS
 */
 #include <math.h>
 #include <vector>
+#include <algorithm>
 #include <cstring>
+#include <charconv>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include "MatrixTools.h"
 #include "MatrixSamplerClass.h"
+#include "PointSetSampler.h"
+#include "Parallel.h"
+#include "SampleOutput.h"
 #include "Scrambling.h"
 #include "CLI11.hpp"
 
@@ -32,74 +40,417 @@ int main(int argc, char** argv)
   CLI::App app{"matBuiler sampler"};
 
   int nDims = 6;
-  app.add_option("-s,--nDims", nDims, "number of dimensions to generate, default: " + std::to_string(nDims));
+  CLI::Option* dims_option = app.add_option("-s,--nDims", nDims, "number of dimensions to generate (all the matrices of binary matrix files by default), default: " + std::to_string(nDims));
   int npts = 9*9*9*9;
   app.add_option("-n,--npts", npts, "number of points to generate, default: " + std::to_string(npts));
   int seed = 133742;
-  app.add_option("--seed", seed, "Random number generator seed (for the scrambling). default: " + std::to_string(seed));
+  app.add_option("--seed", seed, "Random number generator seed (for the scrambling, realization r uses a seed hashed from seed and r). default: " + std::to_string(seed));
   string input_matrices;
-  app.add_option("-i,--idv", input_matrices, "input matrices initialisation (ascii file), default: " +input_matrices)->required();
+  app.add_option("-i,--idv", input_matrices, "input matrices initialisation (ascii file, or binary file from matbuilder --binary), default: " +input_matrices)->required();
   int m = 8;
-  app.add_option("-m,--matrixSize", m,"input matrix size, default: " + std::to_string(m));
+  CLI::Option* m_option = app.add_option("-m,--matrixSize", m,"input matrix size (read from binary matrix files), default: " + std::to_string(m));
   int depth = -1;
   app.add_option("--depth", depth,"scrambling depth (equals matrix size by default)");
   int base = 3;
-  app.add_option("-p,--base", base, "Matrix base, default: " + std::to_string(base));
+  CLI::Option* base_option = app.add_option("-p,--base", base, "Matrix base (read from binary matrix files), default: " + std::to_string(base));
+  std::string scramble_name = "none";
+  CLI::Option* scramble_option = app.add_option("--scramble", scramble_name, "randomization of each realization: none, digitshift (random digit shift), lms (random linear matrix scrambling, no per point cost), lms+shift or owen (Owen permutation), default: " + scramble_name)
+    ->check(CLI::IsMember({"none", "digitshift", "lms", "lms+shift", "owen"}));
   bool owen_permut_flag = false;
-  app.add_flag("--owen", owen_permut_flag,"apply Owen permutation on output points, default: " + std::to_string(owen_permut_flag));
+  app.add_flag("--owen", owen_permut_flag,"apply Owen permutation on output points (same as --scramble owen), default: " + std::to_string(owen_permut_flag));
+  bool shuffle_flag = false;
+  app.add_flag("--shuffle", shuffle_flag, "Owen scramble the point indices of each realization (same permutation in all dimensions): independent progressive sequences, default: " + std::to_string(shuffle_flag));
+  bool owen_legacy_flag = false;
+  app.add_flag("--owen-legacy", owen_legacy_flag, "apply Owen permutation with the original random number generator sequence (reproduces previous versions, slower), default: " + std::to_string(owen_legacy_flag));
   int nbReal = 1;
   app.add_option("--nbReal", nbReal, "number of realizations of the sampler (for the scrambling), default: " + std::to_string(nbReal));
   std::string output_fname = "out.dat";
   app.add_option("-o,--output", output_fname,"output samples filename, default: " + output_fname);
+  std::string format_name = "text";
+  CLI::Option* format_option = app.add_option("--format", format_name, "output format: text, binary header followed by raw little-endian bin32 (float), bin64 (double) or u64 (integer samples), or NumPy array of shape (nbReal, npts, nDims) npy32, npy64 or npyu64 (default for .npy output files), default: " + format_name)
+    ->check(CLI::IsMember({"text", "bin32", "bin64", "u64", "npy32", "npy64", "npyu64"}));
+  bool mmap_flag = false;
+  app.add_flag("--mmap", mmap_flag, "binary formats: preallocate the output file and write it in place from all threads, default: " + std::to_string(mmap_flag));
+  std::string shard_by;
+  app.add_option("--shard-by", shard_by, "write independent shard files in parallel, one per realization (realization) or per K points of each realization (range:K), listed in <output>.manifest");
+  int nbThreads = 1;
+  app.add_option("--threads", nbThreads, "number of generation threads (0: all available), default: " + std::to_string(nbThreads));
   bool dbg_flag = false;
   app.add_option("--dbg", dbg_flag, "dbg_flag, default: " + std::to_string(dbg_flag));
   CLI11_PARSE(app, argc, argv)
 
+  if (owen_legacy_flag) owen_permut_flag = true;
+  if (owen_permut_flag && scramble_option->count() && scramble_name != "owen") {
+    cerr << "Error: --owen and --owen-legacy are not compatible with --scramble " << scramble_name << endl;
+    return -1;
+  }
+  if (owen_permut_flag) scramble_name = "owen";
+  owen_permut_flag = scramble_name == "owen";
+  const bool lms_flag = scramble_name == "lms" || scramble_name == "lms+shift";
+  const bool shift_flag = scramble_name == "digitshift" || scramble_name == "lms+shift";
+  if (shuffle_flag && owen_legacy_flag) {
+    cerr << "Error: --shuffle is not available with --owen-legacy" << endl;
+    return -1;
+  }
+
+  std::vector<std::vector<int> > Cs;
+  if (isBinaryMatrixFile(input_matrices)) {
+    //Matrix size, base and number of dimensions come from the file header
+    MatrixFileHeader desc;
+    std::vector<std::vector<int> > Ms;
+    if (!readMatricesBinary(input_matrices, desc, dims_option->count() ? nDims : -1, Ms)) {
+      return -1;
+    }
+    if ((m_option->count() && m != desc.m) || (base_option->count() && base != desc.base)) {
+      cerr << "Error: " << input_matrices << " contains matrices of size " << desc.m << " in base " << desc.base << endl;
+      return -1;
+    }
+    m = desc.m;
+    base = desc.base;
+    nDims = int(Ms.size());
+    if (desc.cStyle) {
+      Cs.swap(Ms);
+    } else if (!Ms.empty()) {
+      Cs.assign(Ms.size(), std::vector<int>(m*m));
+      B2C(m, base, Ms, Cs);
+    }
+  } else {
+    ifstream in(input_matrices);
+    if (in.fail()) {
+      cerr << "Error: Could not open input file: " << input_matrices << endl;
+      return -1;
+    }
+    if (!readMatrices(in, m, nDims, Cs, base)) {
+      return -1;
+    }
+  }
+
     if (depth == -1)
       depth = m;
 
-  ifstream in(input_matrices);
-  if (in.fail()) {
-    cerr << "Error: Could not open input file: " << input_matrices << endl;
+  const std::string npy_extension = ".npy";
+  if (format_option->count() == 0 && output_fname.size() >= npy_extension.size()
+      && output_fname.compare(output_fname.size() - npy_extension.size(), npy_extension.size(), npy_extension) == 0) {
+    format_name = "npy64";
+  }
+  SampleFormat format;
+  SampleContainer container;
+  parseSampleFormat(format_name, format, container);
+  if (mmap_flag && format == SampleFormat::Text) {
+    cerr << "Error: --mmap requires a binary output format" << endl;
     return -1;
   }
 
-  ofstream out(output_fname);
-  if (out.fail()) {
-    cerr << "Error: Could not open output file: " << output_fname << endl;
+  if (owen_legacy_flag && depth > maxScrambleDepth(base)) {
+    cerr << "Error: --owen-legacy scrambles at most " << maxScrambleDepth(base) << " digits in base " << base << endl;
     return -1;
   }
-  out << setprecision(16);
-
-  std::vector<std::vector<int> > Bs(nDims, std::vector<int>(m*m));
-  std::vector<std::vector<int> > Cs(nDims, std::vector<int>(m*m));
+  if ((owen_permut_flag || shift_flag) && !owen_legacy_flag) {
+    if (format == SampleFormat::UInt64) {
+      if (depth > maxScrambleDepth(base)) {
+        cerr << "Error: --depth " << depth << " does not fit 64 bits integer samples in base " << base
+             << ", use a floating point format" << endl;
+        return -1;
+      }
+    } else {
+      //Deep scrambling: the strong digits of a scrambled sample do not depend on the depth, the weak ones
+      //cannot be represented in the output format
+      depth = std::min(depth, std::max(m, scrambledDigits(base, depth, format == SampleFormat::Float32 ? 24 : 53)));
+    }
+  }
 
-  readMatrices(in, m, nDims, Cs);
+  //Shard size in points
+  int shardSize = 0;
+  if (shard_by == "realization") {
+    shardSize = npts;
+  } else if (shard_by.compare(0, 6, "range:") == 0) {
+    const char* K = shard_by.c_str() + 6;
+    const std::from_chars_result res = std::from_chars(K, K + strlen(K), shardSize);
+    if (res.ec != std::errc() || *res.ptr != '\0' || shardSize <= 0) shardSize = -1;
+  } else if (!shard_by.empty()) {
+    shardSize = -1;
+  }
+  if (shardSize < 0) {
+    cerr << "Error: --shard-by expects realization or range:K with K > 0, got: " << shard_by << endl;
+    return -1;
+  }
 
   if(dbg_flag) {
     writeMatrices(std::cout,m,Cs,true);
   }
 
+  PointSetSampler points(Cs, m, base);
+
+  //Each realization has its own seed, derived from the master seed and its index: realizations are generated in
+  //parallel and the output does not depend on the number of threads (legacy Owen: original sequential draws)
+  std::vector<int> realSeeds(nbReal);
   minstd_rand gen(seed);
   uniform_int_distribution<int> unif;
   for (int real = 0; real < nbReal; ++real) {
-    int real_seed = unif(gen);
-    for (int indpt = 0; indpt < npts; ++indpt) {
-      for (int inddim = 0; inddim < nDims; ++inddim) {
-        double pos;
-        if (owen_permut_flag){
-          pos = getScrambledDouble(Cs[inddim], m, base, indpt, real_seed + inddim, depth);
-        } else {
-          pos = getDouble(Cs[inddim], m, base, indpt);
+    realSeeds[real] = owen_legacy_flag ? unif(gen) : realizationSeed(seed, real);
+  }
+
+  //Points are generated by chunks of consecutive indices: digits and carries are shared by all dimensions.
+  //Chunks are generated in parallel and written in order.
+  const int chunkSize = 4096;
+  //At least one chunk per realization: empty realizations still get their text separator
+  const size_t chunksPerReal = std::max<size_t>(1, (size_t(npts) + chunkSize - 1) / chunkSize);
+  //Debug output is printed while generating
+  if (dbg_flag) nbThreads = 1;
+  const int digits = owen_permut_flag || shift_flag ? depth : m;
+  const double scale = pow(double(base), digits);
+  //Samples are extended with zero digits up to the scrambling depth
+  uint64_t extension = 1;
+  for (int pos = m; pos < depth; ++pos) extension *= uint64_t(base);
+
+  //Randomization of a realization, with seed realSeeds[real] + dim in dimension dim
+  struct Realization {
+    //lms: generator of the scrambled matrices
+    PointSetSampler points;
+    //digit shift: m strong digits (added to the generation state) and depth - m weak digits
+    std::vector<uint64_t> highShifts;
+    std::vector<uint64_t> lowShifts;
+    //owen: one context per dimension
+    std::vector<ScrambleContext> contexts;
+    //shuffle: index scrambling, seed realSeeds[real] + nDims
+    ScrambleContext indexContext;
+  };
+  //Built by the first range of the realization, released once all its points are computed
+  const bool randomized = (owen_permut_flag && !owen_legacy_flag) || lms_flag || shift_flag || shuffle_flag;
+  std::vector<Realization> realizations(randomized ? nbReal : 0);
+  std::unique_ptr<std::once_flag[]> realizationBuilt(new std::once_flag[nbReal]);
+  std::unique_ptr<std::atomic<int>[]> pendingPoints(new std::atomic<int>[nbReal]);
+  for (int real = 0; real < nbReal; ++real) pendingPoints[real] = npts;
+  auto buildRealization = [&](int real) {
+    Realization& r = realizations[real];
+    if (lms_flag) {
+      std::vector<std::vector<int> > scrambled(nDims);
+      for (int dim = 0; dim < nDims; ++dim) {
+        linearScrambleMatrix(Cs[dim], realSeeds[real] + dim, m, base, scrambled[dim]);
+      }
+      r.points.init(scrambled, m, base);
+    }
+    if (shift_flag) {
+      for (int dim = 0; dim < nDims; ++dim) {
+        const uint64_t shift = randomDigitShift(realSeeds[real] + dim, depth, base);
+        r.highShifts.push_back(shift / extension);
+        r.lowShifts.push_back(shift % extension);
+      }
+    }
+    if (owen_permut_flag) {
+      r.contexts.reserve(nDims);
+      for (int dim = 0; dim < nDims; ++dim) {
+        r.contexts.emplace_back(realSeeds[real] + dim, depth, base);
+      }
+    }
+    if (shuffle_flag) {
+      r.indexContext = ScrambleContext(realSeeds[real] + nDims, m, base);
+    }
+  };
+
+  //Computes the integer samples of points first .. first + count - 1 of a realization
+  auto computeRange = [&](int real, int first, int count, std::vector<uint64_t>& ints) {
+    ints.resize(size_t(count) * nDims);
+    if (!randomized) {
+      points.getIntPoints(first, count, ints.data());
+      if (owen_legacy_flag) {
+        for (size_t i = 0; i < ints.size(); ++i) {
+          ints[i] = owenScrambleSample(ints[i], realSeeds[real] + int(i % nDims), m, depth, base, true);
         }
-        out << pos << " ";
-        if(dbg_flag) cout << " " << pos << " | ";
       }
-      out << endl;
-      if(dbg_flag) cout << endl;
+      return;
     }
-    if (real != nbReal-1) out << "#" << endl;
+    std::call_once(realizationBuilt[real], buildRealization, real);
+    const Realization& r = realizations[real];
+    const PointSetSampler& generator = lms_flag ? r.points : points;
+    const uint64_t* shifts = shift_flag ? r.highShifts.data() : nullptr;
+    if (shuffle_flag) {
+      //Shuffled indices are not consecutive: points are computed one by one
+      std::vector<uint64_t> indices(count);
+      for (int i = 0; i < count; ++i) indices[i] = uint64_t(first + i);
+      r.indexContext.scrambleBatch(indices.data(), indices.data(), count);
+      for (int i = 0; i < count; ++i) {
+        generator.getIntPoint(indices[i], &ints[size_t(i) * nDims], shifts);
+      }
+    } else {
+      generator.getIntPoints(first, count, ints.data(), shifts);
+    }
+    if (shift_flag && extension != 1) {
+      for (size_t i = 0; i < ints.size(); ++i) {
+        ints[i] = ints[i] * extension + r.lowShifts[i % nDims];
+      }
+    }
+    if (owen_permut_flag) {
+      //Each dimension has its own seed: samples are scrambled dimension after dimension
+      std::vector<uint64_t> values(count);
+      for (int dim = 0; dim < nDims; ++dim) {
+        for (int i = 0; i < count; ++i) {
+          values[i] = ints[size_t(i) * nDims + dim] * extension;
+        }
+        r.contexts[dim].scrambleBatch(values.data(), values.data(), count);
+        for (int i = 0; i < count; ++i) {
+          ints[size_t(i) * nDims + dim] = values[i];
+        }
+      }
+    }
+    if (pendingPoints[real].fetch_sub(count) == count) {
+      realizations[real] = Realization();
+    }
+  };
+  //Appends the formatted samples of points first .. first + count - 1 of a realization
+  auto generateRange = [&](int real, int first, int count, std::string& text) {
+    std::vector<uint64_t> ints;
+    computeRange(real, first, count, ints);
+    if (format != SampleFormat::Text) {
+      appendSamples(text, format, ints.data(), ints.size(), scale);
+      return;
+    }
+    appendSamplesText(text, ints.data(), ints.size(), nDims, scale);
+    if(dbg_flag) {
+      for (size_t i = 0; i < ints.size(); ++i) {
+        cout << " " << setprecision(16) << double(ints[i]) / scale << " | ";
+        if ((i + 1) % nDims == 0) cout << endl;
+      }
+    }
+  };
+  //Writes the points first .. first + count - 1 of a realization in a standalone file
+  auto writeFile = [&](const std::string& fname, int real, int first, int count) {
+    const std::string header = container == SampleContainer::Npy ? npyHeader(format, 1, count, nDims)
+                               : sampleHeader(format, nDims, count, 1, base, m, digits);
+    if (mmap_flag) {
+      MappedOutput mapped;
+      if (!mapped.open(fname, header.size() + size_t(count) * nDims * sampleSize(format))) return false;
+      std::copy(header.begin(), header.end(), mapped.data());
+      std::vector<uint64_t> ints;
+      for (int i = 0; i < count; i += chunkSize) {
+        computeRange(real, first + i, std::min(chunkSize, count - i), ints);
+        storeSamples(mapped.data() + header.size() + size_t(i) * nDims * sampleSize(format), format, ints.data(), ints.size(), scale);
+      }
+      return mapped.close();
+    }
+    ofstream out(fname, format == SampleFormat::Text ? ios::out : ios::out | ios::binary);
+    if (format != SampleFormat::Text) {
+      out.write(header.data(), header.size());
+    }
+    std::string text;
+    for (int i = 0; i < count && out; i += chunkSize) {
+      text.clear();
+      generateRange(real, first + i, std::min(chunkSize, count - i), text);
+      out.write(text.data(), text.size());
+    }
+    out.close();
+    return !out.fail();
+  };
+
+  if (!shard_by.empty()) {
+    //Shard files are named after the output file: <stem>.r<realization>[.p<shard>]<extension>
+    const size_t slash = output_fname.find_last_of('/');
+    const size_t dot = output_fname.find_last_of('.');
+    const size_t stemEnd = dot != string::npos && (slash == string::npos || dot > slash) ? dot : output_fname.size();
+    const std::string directory = slash == string::npos ? "" : output_fname.substr(0, slash + 1);
+    const std::string stem = output_fname.substr(0, stemEnd);
+    const std::string extension = output_fname.substr(stemEnd);
+    //Empty realizations still get a (header only) shard file listed in the manifest
+    const int shardsPerReal = npts == 0 ? 1 : (npts + shardSize - 1) / shardSize;
+    const size_t nbShards = size_t(shardsPerReal) * nbReal;
+    auto padded = [](int v, int count) {
+      std::string digits = std::to_string(v);
+      return std::string(std::to_string(std::max(count - 1, 0)).size() - digits.size(), '0') + digits;
+    };
+    std::vector<std::string> names(nbShards);
+    for (size_t shard = 0; shard < nbShards; ++shard) {
+      names[shard] = stem + ".r" + padded(int(shard / shardsPerReal), nbReal);
+      if (shardsPerReal > 1) names[shard] += ".p" + padded(int(shard % shardsPerReal), shardsPerReal);
+      names[shard] += extension;
+    }
+    std::vector<char> written(nbShards);
+    parallelFor(nbThreads, nbShards, [&](size_t shard) {
+      const int first = int(shard % shardsPerReal) * shardSize;
+      written[shard] = writeFile(names[shard], int(shard / shardsPerReal), first, std::min(shardSize, npts - first));
+    });
+    for (size_t shard = 0; shard < nbShards; ++shard) {
+      if (!written[shard]) {
+        cerr << "Error: Could not write output file: " << names[shard] << endl;
+        return -1;
+      }
+    }
+    const std::string manifest_fname = stem + ".manifest";
+    ofstream manifest(manifest_fname);
+    manifest << "# matbuilder sampler shards: file realization first_point nb_points" << endl;
+    manifest << "format " << format_name << endl;
+    manifest << "nDims " << nDims << endl;
+    manifest << "npts " << npts << endl;
+    manifest << "nbReal " << nbReal << endl;
+    manifest << "base " << base << endl;
+    manifest << "m " << m << endl;
+    manifest << "digits " << digits << endl;
+    for (size_t shard = 0; shard < nbShards; ++shard) {
+      const int first = int(shard % shardsPerReal) * shardSize;
+      manifest << names[shard].substr(directory.size()) << " " << shard / shardsPerReal << " " << first << " "
+               << std::min(shardSize, npts - first) << endl;
+    }
+    manifest.close();
+    if (manifest.fail()) {
+      cerr << "Error: Could not write output file: " << manifest_fname << endl;
+      return -1;
+    }
+    return 0;
   }
+
+  const size_t nbChunks = chunksPerReal * nbReal;
+  auto chunkRange = [&](size_t chunk, int& real, int& first, int& count) {
+    real = int(chunk / chunksPerReal);
+    first = int(chunk % chunksPerReal) * chunkSize;
+    count = std::min(chunkSize, npts - first);
+  };
+
+  if (mmap_flag) {
+    //Fixed size samples: each chunk is written in place, in any order
+    const std::string header = container == SampleContainer::Npy ? npyHeader(format, nbReal, npts, nDims)
+                               : sampleHeader(format, nDims, npts, nbReal, base, m, digits);
+    const size_t valueSize = sampleSize(format);
+    MappedOutput mapped;
+    if (!mapped.open(output_fname, header.size() + size_t(nbReal) * npts * nDims * valueSize)) {
+      cerr << "Error: Could not map output file: " << output_fname << endl;
+      return -1;
+    }
+    std::copy(header.begin(), header.end(), mapped.data());
+    parallelFor(nbThreads, nbChunks, [&](size_t chunk) {
+      int real, first, count;
+      chunkRange(chunk, real, first, count);
+      std::vector<uint64_t> ints;
+      computeRange(real, first, count, ints);
+      const size_t offset = (size_t(real) * npts + first) * nDims;
+      storeSamples(mapped.data() + header.size() + offset * valueSize, format, ints.data(), ints.size(), scale);
+    });
+    if (!mapped.close()) {
+      cerr << "Error: Could not write output file: " << output_fname << endl;
+      return -1;
+    }
+    return 0;
+  }
+
+  ofstream out(output_fname, format == SampleFormat::Text ? ios::out : ios::out | ios::binary);
+  if (out.fail()) {
+    cerr << "Error: Could not open output file: " << output_fname << endl;
+    return -1;
+  }
+  if (format != SampleFormat::Text) {
+    const std::string header = container == SampleContainer::Npy ? npyHeader(format, nbReal, npts, nDims)
+                               : sampleHeader(format, nDims, npts, nbReal, base, m, digits);
+    out.write(header.data(), header.size());
+  }
+
+  auto generateChunk = [&](size_t chunk, std::string& text) {
+    int real, first, count;
+    chunkRange(chunk, real, first, count);
+    generateRange(real, first, count, text);
+    //Realizations are separated by # lines in text format
+    const bool lastOfReal = first + count == npts;
+    if (format == SampleFormat::Text && lastOfReal && real + 1 != nbReal) text += "#\n";
+  };
+  parallelOrdered(nbThreads, nbChunks, generateChunk,
+                  [&](const std::string& text) { out.write(text.data(), text.size()); });
   out.close();
 
 }